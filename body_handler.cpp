@@ -0,0 +1,82 @@
+#include "body_handler.h"
+
+#include <stdio.h>
+
+#include <string_view>
+
+#include "buffer_pool.h"
+#include "file_cache.h"
+#include "http_conn.h"
+
+bool body_sink::begin(http_conn &conn) {
+    conn.user_data() = 14695981039346656037ULL;  // FNV-1a的初始值
+    return true;
+}
+
+bool body_sink::data(http_conn &conn, const char *buf, int len) {
+    uint64_t h = conn.user_data();
+    for (int i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t)buf[i]) * 1099511628211ULL;
+    }
+    conn.user_data() = h;
+    return true;
+}
+
+bool body_sink::end(http_conn &conn) {
+    char text[64];
+    int len = snprintf(text, sizeof(text), "received %lld bytes, fnv1a %016llx\n",
+                       conn.get_body_received(), (unsigned long long)conn.user_data());
+    return conn.reply(200, "OK", "text/plain", text, len);
+}
+
+bool health_handler::end(http_conn &conn) {
+    return conn.reply(200, "OK", "text/plain", "ok\n", 3);
+}
+
+namespace {
+
+const char *const STATS_GROUPS[] = {"connections", "buffer_pool", "file_cache", "response_cache"};
+
+// 按组写出JSON的值，返回写入的字节数
+int format_group(int group, char *buf, int size) {
+    size_t entries, bytes, hits, misses;
+    switch (group) {
+        case 0: return snprintf(buf, size, "%d", http_conn::m_user_count.load());
+        case 1:
+            return snprintf(buf, size, "{\"4k\":%zu,\"16k\":%zu,\"64k\":%zu}",
+                            buffer_pool::allocated(0), buffer_pool::allocated(1),
+                            buffer_pool::allocated(2));
+        case 2:
+            file_cache::stats(entries, bytes, hits, misses);
+            return snprintf(buf, size,
+                            "{\"entries\":%zu,\"bytes\":%zu,\"hits\":%zu,\"misses\":%zu}", entries,
+                            bytes, hits, misses);
+        default:
+            file_cache::response_stats(bytes, hits, misses);
+            return snprintf(buf, size, "{\"bytes\":%zu,\"hits\":%zu,\"misses\":%zu}", bytes, hits,
+                            misses);
+    }
+}
+
+}  // namespace
+
+bool stats_handler::end(http_conn &conn) {
+    std::string_view group;
+    bool one = conn.get_param("group", group);
+    char text[512];
+    int len = 0;
+    for (int g = 0; g < (int)(sizeof(STATS_GROUPS) / sizeof(STATS_GROUPS[0])); ++g) {
+        if (one && group != STATS_GROUPS[g]) {
+            continue;
+        }
+        len += snprintf(text + len, sizeof(text) - len, "%s\"%s\":", len == 0 ? "{" : ",",
+                        STATS_GROUPS[g]);
+        len += format_group(g, text + len, sizeof(text) - len);
+    }
+    if (len == 0) {
+        static const char missing[] = "unknown stats group\n";
+        return conn.reply(404, "Not Found", "text/plain", missing, sizeof(missing) - 1);
+    }
+    len += snprintf(text + len, sizeof(text) - len, "}\n");
+    return conn.reply(200, "OK", "application/json", text, len);
+}
@@ -0,0 +1,48 @@
+#ifndef BODY_HANDLER_H
+#define BODY_HANDLER_H
+
+class http_conn;
+
+// 动态请求的处理者，由路由(router)按请求方法和路径选出，处理者生成的响应写入连接的写缓冲区
+// 请求体不在读缓冲区中攒齐，而是边接收边按块交给处理者：Content-Length给出长度的原样交出，
+// Transfer-Encoding: chunked的先在读缓冲区中就地解码。除了最后一块，每块都是http_conn::BODY_CHUNK字节
+// (读缓冲区的上限放不下一整块时例外)，一个连接接收请求体时占用的内存与请求体的大小无关。
+// 没有请求体的请求(GET/HEAD)只调用begin和end。
+// 回调都在工作线程中进行，可以阻塞；同一个连接上的回调不会并发，同一个处理者会被多个连接同时使用
+class body_handler {
+public:
+    virtual ~body_handler() {}
+    // 收完请求头部、开始接收请求体之前调用；返回false时拒绝这个请求，回复403
+    virtual bool begin(http_conn & /*conn*/) {
+        return true;
+    }
+    // 按顺序收到请求体的一块，返回false时中止请求，回复500后关闭连接；默认丢弃
+    virtual bool data(http_conn & /*conn*/, const char * /*buf*/, int /*len*/) {
+        return true;
+    }
+    // 请求体收完，用conn.reply生成响应；返回false或者没有生成响应时回复500
+    virtual bool end(http_conn &conn) = 0;
+};
+
+// 丢弃请求体，回复收到的字节数和内容的FNV-1a哈希，用于测试上传
+class body_sink : public body_handler {
+public:
+    bool begin(http_conn &conn);
+    bool data(http_conn &conn, const char *buf, int len);
+    bool end(http_conn &conn);
+};
+
+// 健康检查，总是回复ok
+class health_handler : public body_handler {
+public:
+    bool end(http_conn &conn);
+};
+
+// 以JSON回复连接数、缓冲池、文件缓存和响应缓存的统计；
+// 路由捕获了参数group时只回复这一组，没有这一组时回复404
+class stats_handler : public body_handler {
+public:
+    bool end(http_conn &conn);
+};
+
+#endif
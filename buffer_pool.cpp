@@ -0,0 +1,109 @@
+#include "buffer_pool.h"
+
+#include <atomic>
+#include <vector>
+
+#include "locker.h"
+
+#define BUF_CACHE_BYTES (256 * 1024)  // 每个线程每一级本地缓存的上限，按字节计
+
+namespace {
+
+const int g_class_size[BUF_CLASS_NUM] = {BUF_CLASS_MIN, 16384, BUF_CLASS_MAX};
+
+// 一级缓冲区的全局空闲链表
+struct size_class {
+    locker lock;
+    std::vector<char *> free;
+    std::atomic<size_t> allocated;  // 累计向系统申请的个数
+
+    // 进程退出时，连接和各线程的本地缓存都已把缓冲区交还到这里
+    ~size_class() {
+        for (size_t i = 0; i < free.size(); ++i) {
+            delete[] free[i];
+        }
+    }
+};
+
+size_class g_classes[BUF_CLASS_NUM];
+
+// 每级本地缓存最多保存的个数，大的缓冲区少缓存几个
+int cache_limit(int cls) {
+    int n = BUF_CACHE_BYTES / g_class_size[cls];
+    return n < 2 ? 2 : n;
+}
+
+// 线程的本地缓存，线程退出时把缓存的缓冲区交还给全局链表
+struct local_cache {
+    std::vector<char *> free[BUF_CLASS_NUM];
+
+    ~local_cache() {
+        for (int i = 0; i < BUF_CLASS_NUM; ++i) {
+            g_classes[i].lock.lock();
+            g_classes[i].free.insert(g_classes[i].free.end(), free[i].begin(), free[i].end());
+            g_classes[i].lock.unlock();
+        }
+    }
+};
+
+thread_local local_cache t_cache;
+
+int class_of(int size) {
+    for (int i = 0; i < BUF_CLASS_NUM; ++i) {
+        if (size <= g_class_size[i]) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+}  // namespace
+
+char *buffer_pool::acquire(int size, int &cap) {
+    int cls = class_of(size);
+    if (cls < 0) {
+        return NULL;
+    }
+    cap = g_class_size[cls];
+    std::vector<char *> &cache = t_cache.free[cls];
+    if (cache.empty()) {
+        // 本地缓存空了，从全局链表一次取走半个缓存的量
+        size_class &c = g_classes[cls];
+        c.lock.lock();
+        size_t n = c.free.size() < (size_t)cache_limit(cls) / 2 ? c.free.size()
+                                                                 : (size_t)cache_limit(cls) / 2;
+        cache.insert(cache.end(), c.free.end() - n, c.free.end());
+        c.free.resize(c.free.size() - n);
+        c.lock.unlock();
+    }
+    if (cache.empty()) {
+        g_classes[cls].allocated.fetch_add(1, std::memory_order_relaxed);
+        return new char[cap];
+    }
+    char *buf = cache.back();
+    cache.pop_back();
+    return buf;
+}
+
+void buffer_pool::release(char *buf, int cap) {
+    int cls = class_of(cap);
+    std::vector<char *> &cache = t_cache.free[cls];
+    cache.push_back(buf);
+    if (cache.size() > (size_t)cache_limit(cls)) {
+        // 本地缓存满了，把一半交还给全局链表，留给正在取用的线程
+        size_t n = cache.size() / 2;
+        size_class &c = g_classes[cls];
+        c.lock.lock();
+        c.free.insert(c.free.end(), cache.end() - n, cache.end());
+        c.lock.unlock();
+        cache.resize(cache.size() - n);
+    }
+}
+
+int buffer_pool::class_size(int i) {
+    return g_class_size[i];
+}
+
+size_t buffer_pool::allocated(int i) {
+    return g_classes[i].allocated.load(std::memory_order_relaxed);
+}
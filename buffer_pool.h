@@ -0,0 +1,30 @@
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#include <stddef.h>
+
+// 连接读写缓冲区的分级缓冲池
+// 缓冲区按4K、16K、64K三个尺寸分级，连接先拿最小的，放不下时换成下一级并拷贝已有的数据；
+// 连接空闲或关闭时把缓冲区还回来，留给其他连接使用，不归还给系统。
+// 每个线程有一个小的本地缓存，取用和归还通常不加锁；本地缓存空了或满了才与全局的空闲链表成批交换。
+// 缓冲区可以在一个线程取出、在另一个线程归还(工作线程生成响应，reactor线程发送完后归还)
+enum {
+    BUF_CLASS_NUM = 3,
+    BUF_CLASS_MIN = 4096,   // 最小一级的尺寸
+    BUF_CLASS_MAX = 65536,  // 最大一级的尺寸，单个请求或响应头不能超过它
+};
+
+class buffer_pool {
+public:
+    // 取一个不小于size的缓冲区，cap返回它的实际大小；size超过BUF_CLASS_MAX时返回NULL
+    static char *acquire(int size, int &cap);
+    // 归还acquire得到的缓冲区，cap为当时返回的大小
+    static void release(char *buf, int cap);
+
+    // 第i级的尺寸
+    static int class_size(int i);
+    // 第i级累计向系统申请的缓冲区个数
+    static size_t allocated(int i);
+};
+
+#endif
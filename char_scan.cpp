@@ -0,0 +1,158 @@
+#include "char_scan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define CHAR_SCAN_X86
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const char *find_eol_scalar(const char *p, const char *end) {
+    for (; p < end; ++p) {
+        if (*p == '\r' || *p == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
+
+const char *find_char_scalar(const char *p, const char *end, char c) {
+    for (; p < end; ++p) {
+        if (*p == c) {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef CHAR_SCAN_X86
+// PCMPESTRI：在16字节中查找set里前n个字符中任意一个首次出现的位置，没有时为16
+#define CHAR_SCAN_MODE (_SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT)
+
+__attribute__((target("sse4.2"))) const char *find_eol_sse42(const char *p, const char *end) {
+    const __m128i set = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int i = _mm_cmpestri(set, 2, v, 16, CHAR_SCAN_MODE);
+        if (i != 16) {
+            return p + i;
+        }
+    }
+    return find_eol_scalar(p, end);
+}
+
+__attribute__((target("sse4.2"))) const char *find_char_sse42(const char *p, const char *end,
+                                                               char c) {
+    const __m128i set = _mm_cvtsi32_si128((unsigned char)c);
+    for (; end - p >= 16; p += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        int i = _mm_cmpestri(set, 1, v, 16, CHAR_SCAN_MODE);
+        if (i != 16) {
+            return p + i;
+        }
+    }
+    return find_char_scalar(p, end, c);
+}
+
+// 支持AVX2的CPU都支持SSE4.2，不足32字节的尾部交给SSE4.2的实现
+__attribute__((target("avx2"))) const char *find_eol_avx2(const char *p, const char *end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_eol_sse42(p, end);
+}
+
+__attribute__((target("avx2"))) const char *find_char_avx2(const char *p, const char *end,
+                                                            char c) {
+    const __m256i cv = _mm256_set1_epi8(c);
+    for (; end - p >= 32; p += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)p);
+        unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, cv));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+    }
+    return find_char_sse42(p, end, c);
+}
+#endif
+
+bool supported(char_scan::LEVEL l) {
+#ifdef CHAR_SCAN_X86
+    // 在其他全局对象的构造函数中使用前须先初始化
+    __builtin_cpu_init();
+    switch (l) {
+        case char_scan::AVX2: return __builtin_cpu_supports("avx2");
+        case char_scan::SSE42: return __builtin_cpu_supports("sse4.2");
+        default: return true;
+    }
+#else
+    return l == char_scan::SCALAR;
+#endif
+}
+
+char_scan::LEVEL best_level() {
+    if (supported(char_scan::AVX2)) {
+        return char_scan::AVX2;
+    }
+    if (supported(char_scan::SSE42)) {
+        return char_scan::SSE42;
+    }
+    return char_scan::SCALAR;
+}
+
+char_scan::LEVEL g_level = char_scan::SCALAR;
+
+}  // namespace
+
+// 函数指针是常量初始化的，在选择实现之前被调用也能用逐字节的实现
+const char *(*char_scan::find_eol)(const char *, const char *) = find_eol_scalar;
+const char *(*char_scan::find_char)(const char *, const char *, char) = find_char_scalar;
+
+char_scan::LEVEL char_scan::level() {
+    return g_level;
+}
+
+const char *char_scan::level_name(LEVEL l) {
+    static const char *names[] = {"scalar", "sse4.2", "avx2"};
+    return names[l];
+}
+
+bool char_scan::select(LEVEL l) {
+    if (!supported(l)) {
+        return false;
+    }
+    switch (l) {
+#ifdef CHAR_SCAN_X86
+        case AVX2:
+            find_eol = find_eol_avx2;
+            find_char = find_char_avx2;
+            break;
+        case SSE42:
+            find_eol = find_eol_sse42;
+            find_char = find_char_sse42;
+            break;
+#endif
+        default:
+            find_eol = find_eol_scalar;
+            find_char = find_char_scalar;
+            break;
+    }
+    g_level = l;
+    return true;
+}
+
+namespace {
+// 启动时选择CPU支持的最高一级
+struct auto_select {
+    auto_select() {
+        char_scan::select(best_level());
+    }
+} g_auto_select;
+}  // namespace
@@ -0,0 +1,23 @@
+#ifndef CHAR_SCAN_H
+#define CHAR_SCAN_H
+
+// 解析请求时查找行结束符和头部分隔符，按CPU支持的指令集在运行时选择实现：
+// avx2：一次比较32字节；sse42：用PCMPESTRI一次在16字节中查找一组字符；scalar：逐字节查找，
+// 非x86平台只有这一种。向量实现只读取[p, end)以内的数据，不足一个向量的尾部换用更窄的实现
+class char_scan {
+public:
+    enum LEVEL { SCALAR = 0, SSE42, AVX2 };
+
+    // 在[p, end)中查找第一个'\r'或'\n'，没有时返回end
+    static const char *(*find_eol)(const char *p, const char *end);
+    // 在[p, end)中查找第一个c，没有时返回end
+    static const char *(*find_char)(const char *p, const char *end, char c);
+
+    // 当前使用的实现，启动时选择CPU支持的最高一级
+    static LEVEL level();
+    static const char *level_name(LEVEL l);
+    // 改用指定的实现，CPU不支持时返回false，供基准测试对比各级实现
+    static bool select(LEVEL l);
+};
+
+#endif
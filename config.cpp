@@ -0,0 +1,202 @@
+#include "config.h"
+
+#include <getopt.h>
+#include <libgen.h>
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "buffer_pool.h"
+#include "cpu_affinity.h"
+
+server_config::server_config()
+    : port(9999),
+      et(false),
+      async_log(false),
+      reactors(1),
+      backend(BACKEND_EPOLL),
+      timer(TIMER_WHEEL),
+      lazy_timer(true),
+      min_threads(4),
+      max_threads(32),
+      max_request(BUF_CLASS_MAX),
+      max_response_header(16384),
+      file_cache_bytes(64 * 1024 * 1024),
+      file_cache_entries(1024),
+      file_cache_revalidate(1000),
+      response_cache_limit(65536),
+      sendfile_threshold(65536),
+      inline_hits(true),
+      header_timeout(10000),
+      keepalive_timeout(15000),
+      write_timeout(15000),
+      body_timeout(15000) {}
+
+void server_config::usage(const char *prog) {
+    std::cout << "请按照如下格式运行：" << basename((char *)prog)
+              << " port_number ET Log [--reactors N] [--backend epoll|uring] [--timer wheel|heap|list]"
+                 " [--timer-refresh lazy|eager] [--min-threads N] [--max-threads N] [--cpus LIST]"
+                 " [--max-request BYTES] [--max-response-header BYTES]"
+                 " [--file-cache-bytes BYTES] [--file-cache-entries N] [--file-cache-revalidate MS]"
+                 " [--response-cache-limit BYTES] [--sendfile-threshold BYTES]"
+                 " [--inline-hits on|off]"
+                 " [--header-timeout MS] [--keepalive-timeout MS] [--write-timeout MS]"
+                 " [--body-timeout MS]\n";
+    std::cout << "其中ET代表是否开启EPOLL的边沿触发，可选1(开启)或0(不开启)\n";
+    std::cout << "其中Log代表是否开启异步日志系统，可选1(异步日志)或0(同步日志)\n";
+    std::cout << "--reactors N  启动N个reactor线程，每个线程拥有独立的SO_REUSEPORT监听socket、"
+                 "epoll实例和定时器链表，默认为1\n";
+    std::cout << "--backend B    事件后端，epoll(默认)或uring。uring使用io_uring的multishot accept、"
+                 "multishot recv和链式send\n";
+    std::cout << "--timer T      连接超时使用的定时器，wheel(默认，分层时间轮，O(1)插入和刷新)、"
+                 "heap(最小堆，O(log n))或list(升序链表)\n";
+    std::cout << "--timer-refresh R  lazy(默认)：连接有活动时只记下新的超时时间，定时器到期时再重排；"
+                 "eager：每次活动都立即调整定时器的位置\n";
+    std::cout << "--min-threads N  工作线程数的下限，默认4；空闲时逐个回收线程，但不少于N个\n";
+    std::cout << "--max-threads N  工作线程数的上限，默认32；请求排队变久且线程都很忙时扩容，"
+                 "与下限相等时线程数固定\n";
+    std::cout << "--cpus LIST     绑核，格式同taskset -c，例如0-3,8。第i个reactor和第i个工作线程"
+                 "绑定在列表中第i%n个CPU上，事件后端和任务队列在所在CPU的NUMA节点上分配，"
+                 "reactor个数不超过CPU个数时按网卡中断所在的CPU把新连接交给同核的reactor\n";
+    std::cout << "--max-request BYTES  一个连接最多占用的读缓冲区，默认65536，不能超过65536；"
+                 "缓冲区按4K、16K、64K逐级增长。请求行和头部放不下时回复400后关闭连接，"
+                 "请求体边接收边交给处理者，不受这个限制\n";
+    std::cout << "--max-response-header BYTES  响应头最多占用的写缓冲区，默认16384，不能超过65536\n";
+    std::cout << "--file-cache-bytes BYTES  静态文件缓存占用的内存上限(完整响应和映射)，"
+                 "默认67108864(64MB)，占用超过上限的1/16的文件不缓存\n";
+    std::cout << "--file-cache-entries N    静态文件缓存的条目数上限，默认1024，每个条目占一个fd；"
+                 "0表示不缓存，每个请求都重新打开文件\n";
+    std::cout << "--file-cache-revalidate MS  缓存的文件每隔多少毫秒用stat重新校验一次，默认1000，"
+                 "0表示每次命中都校验；文件被修改或替换后丢弃旧的映射\n";
+    std::cout << "--response-cache-limit BYTES  小于这个大小的文件在内存中保存序列化好的完整响应"
+                 "(状态行、响应头和内容)，命中时一次send发完，默认65536；0表示不保存\n";
+    std::cout << "--sendfile-threshold BYTES  不小于这个大小的文件不做映射，响应体用sendfile"
+                 "(io_uring后端用splice)直接从页缓存发送，默认65536；0表示所有文件都这样发送\n";
+    std::cout << "--inline-hits on|off  on(默认)：reactor线程先自己解析请求，响应缓存命中的直接发送，"
+                 "只有未命中的请求和错误请求才交给线程池；off：所有请求都由线程池解析和处理\n";
+    std::cout << "--header-timeout MS     从请求的第一个字节起收完请求行和头部的时限，默认10000毫秒\n";
+    std::cout << "--keepalive-timeout MS  保持连接时两个请求之间的最长空闲时间，默认15000毫秒\n";
+    std::cout << "--write-timeout MS      发送响应时允许的最长无进展时间，默认15000毫秒\n";
+    std::cout << "--body-timeout MS       接收请求体时允许的最长无进展时间，默认15000毫秒\n";
+}
+
+bool server_config::parse_arg(int argc, char *argv[]) {
+    static const struct option long_opts[] = {
+        {"reactors", required_argument, NULL, 'r'},
+        {"backend", required_argument, NULL, 'b'},
+        {"timer", required_argument, NULL, 't'},
+        {"timer-refresh", required_argument, NULL, 'l'},
+        {"min-threads", required_argument, NULL, 'n'},
+        {"max-threads", required_argument, NULL, 'm'},
+        {"cpus", required_argument, NULL, 'c'},
+        {"max-request", required_argument, NULL, 'q'},
+        {"max-response-header", required_argument, NULL, 'p'},
+        {"file-cache-bytes", required_argument, NULL, 'B'},
+        {"file-cache-entries", required_argument, NULL, 'E'},
+        {"file-cache-revalidate", required_argument, NULL, 'V'},
+        {"response-cache-limit", required_argument, NULL, 'R'},
+        {"sendfile-threshold", required_argument, NULL, 'S'},
+        {"inline-hits", required_argument, NULL, 'i'},
+        {"header-timeout", required_argument, NULL, 'h'},
+        {"keepalive-timeout", required_argument, NULL, 'k'},
+        {"write-timeout", required_argument, NULL, 'w'},
+        {"body-timeout", required_argument, NULL, 'd'},
+        {NULL, 0, NULL, 0},
+    };
+
+    // getopt_long会把非选项参数挪到末尾，因此位置参数与选项的先后顺序不受限制
+    int opt;
+    while ((opt = getopt_long(argc, argv, "", long_opts, NULL)) != -1) {
+        switch (opt) {
+            case 'r': reactors = atoi(optarg); break;
+            case 'b': {
+                if (strcasecmp(optarg, "epoll") == 0) {
+                    backend = BACKEND_EPOLL;
+                } else if (strcasecmp(optarg, "uring") == 0 ||
+                           strcasecmp(optarg, "io_uring") == 0) {
+                    backend = BACKEND_URING;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 't': {
+                if (strcasecmp(optarg, "list") == 0) {
+                    timer = TIMER_LIST;
+                } else if (strcasecmp(optarg, "wheel") == 0) {
+                    timer = TIMER_WHEEL;
+                } else if (strcasecmp(optarg, "heap") == 0) {
+                    timer = TIMER_HEAP;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 'l': {
+                if (strcasecmp(optarg, "lazy") == 0) {
+                    lazy_timer = true;
+                } else if (strcasecmp(optarg, "eager") == 0) {
+                    lazy_timer = false;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 'n': min_threads = atoi(optarg); break;
+            case 'm': max_threads = atoi(optarg); break;
+            case 'c': {
+                if (!parse_cpu_list(optarg, cpus)) {
+                    return false;
+                }
+                break;
+            }
+            case 'q': max_request = atoi(optarg); break;
+            case 'p': max_response_header = atoi(optarg); break;
+            case 'B': file_cache_bytes = strtoull(optarg, NULL, 10); break;
+            case 'E': file_cache_entries = atoi(optarg); break;
+            case 'V': file_cache_revalidate = atoi(optarg); break;
+            case 'R': response_cache_limit = strtoull(optarg, NULL, 10); break;
+            case 'S': sendfile_threshold = strtoull(optarg, NULL, 10); break;
+            case 'i': {
+                if (strcasecmp(optarg, "on") == 0) {
+                    inline_hits = true;
+                } else if (strcasecmp(optarg, "off") == 0) {
+                    inline_hits = false;
+                } else {
+                    return false;
+                }
+                break;
+            }
+            case 'h': header_timeout = atoi(optarg); break;
+            case 'k': keepalive_timeout = atoi(optarg); break;
+            case 'w': write_timeout = atoi(optarg); break;
+            case 'd': body_timeout = atoi(optarg); break;
+            default: return false;
+        }
+    }
+
+    // 位置参数：port ET Log
+    if (argc - optind < 3) {
+        return false;
+    }
+    port = atoi(argv[optind]);
+    et = atoi(argv[optind + 1]) ? true : false;
+    async_log = atoi(argv[optind + 2]) ? true : false;
+
+    if (reactors <= 0 || header_timeout <= 0 || keepalive_timeout <= 0 || write_timeout <= 0 ||
+        body_timeout <= 0) {
+        return false;
+    }
+    if (min_threads <= 0 || max_threads < min_threads) {
+        return false;
+    }
+    if (file_cache_entries < 0 || file_cache_revalidate < 0) {
+        return false;
+    }
+    if (max_request < 1024 || max_request > BUF_CLASS_MAX || max_response_header < 1024 ||
+        max_response_header > BUF_CLASS_MAX) {
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,52 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <stddef.h>
+
+#include <vector>
+
+// 服务器启动参数
+// 兼容原有的位置参数：port ET Log，其余参数均以 --name value 的形式给出
+class server_config {
+public:
+    server_config();
+
+    // 解析命令行参数，参数有误时返回false
+    bool parse_arg(int argc, char *argv[]);
+    // 打印用法
+    static void usage(const char *prog);
+
+    // 事件后端
+    enum BACKEND { BACKEND_EPOLL = 0, BACKEND_URING };
+    // 定时器容器
+    enum TIMER { TIMER_LIST = 0, TIMER_WHEEL, TIMER_HEAP };
+
+public:
+    int port;         // 端口号
+    bool et;          // 是否开启EPOLL的边沿触发
+    bool async_log;   // 是否开启异步日志
+    int reactors;     // reactor(事件循环线程)个数，每个reactor独占一个监听socket和事件后端
+    BACKEND backend;  // 事件后端，epoll或io_uring
+    TIMER timer;      // 连接超时使用的定时器容器，升序链表、分层时间轮或时间堆
+    bool lazy_timer;  // 是否惰性刷新定时器，连接有活动时只记下新的超时时间，到期时再调整
+    int min_threads;  // 工作线程数的下限，线程池启动时创建这么多线程
+    int max_threads;  // 工作线程数的上限，排队时间变长且线程都很忙时逐步扩容到这里
+    int max_request;              // 一个连接最多占用的读缓冲区字节数，请求头部放不下时回复400
+    int max_response_header;      // 响应头最多占用的写缓冲区字节数
+    size_t file_cache_bytes;      // 文件缓存占用的内存上限(完整响应和映射)
+    int file_cache_entries;       // 文件缓存的条目数上限，0表示不缓存
+    int file_cache_revalidate;    // 缓存的文件每隔多少毫秒用stat重新校验一次，0表示每次命中都校验
+    size_t response_cache_limit;  // 小于这个字节数的文件在内存中保存完整的响应，一次send发完
+    size_t sendfile_threshold;    // 不小于这个字节数的文件用sendfile/splice发送，其余映射后writev
+    bool inline_hits;             // 响应缓存命中的请求是否直接在reactor线程中发送，不经过线程池
+    // 绑定的CPU，为空时不绑核。第i个reactor和第i个工作线程都绑定在cpus[i % cpus.size()]上
+    std::vector<int> cpus;
+
+    // 连接各阶段的超时时间，毫秒
+    int header_timeout;     // 从请求的第一个字节起，须在此时间内收完请求行和头部
+    int keepalive_timeout;  // 保持连接时，两个请求之间允许的最长空闲时间
+    int write_timeout;      // 发送响应时，允许的最长无进展时间
+    int body_timeout;       // 接收请求体时，允许的最长无进展时间
+};
+
+#endif
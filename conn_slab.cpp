@@ -0,0 +1,74 @@
+#include "conn_slab.h"
+
+conn_table::conn_table(int max_fd) : m_leaf_count((max_fd + CONN_TABLE_LEAF - 1) / CONN_TABLE_LEAF) {
+    m_leaves = new std::atomic<std::atomic<http_conn *> *>[m_leaf_count];
+    for (int i = 0; i < m_leaf_count; ++i) {
+        m_leaves[i].store(NULL, std::memory_order_relaxed);
+    }
+}
+
+conn_table::~conn_table() {
+    for (int i = 0; i < m_leaf_count; ++i) {
+        delete[] m_leaves[i].load(std::memory_order_relaxed);
+    }
+    delete[] m_leaves;
+}
+
+void conn_table::set(int fd, http_conn *conn) {
+    std::atomic<std::atomic<http_conn *> *> &slot = m_leaves[fd / CONN_TABLE_LEAF];
+    std::atomic<http_conn *> *leaf = slot.load(std::memory_order_acquire);
+    if (leaf == NULL) {
+        // 多个reactor可能同时用到同一个叶子中的fd，只有一个能装上自己的叶子，其余的释放掉
+        std::atomic<http_conn *> *fresh = new std::atomic<http_conn *>[CONN_TABLE_LEAF];
+        for (int i = 0; i < CONN_TABLE_LEAF; ++i) {
+            fresh[i].store(NULL, std::memory_order_relaxed);
+        }
+        if (slot.compare_exchange_strong(leaf, fresh, std::memory_order_acq_rel)) {
+            leaf = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    leaf[fd % CONN_TABLE_LEAF].store(conn, std::memory_order_release);
+}
+
+size_t conn_table::memory() const {
+    size_t bytes = m_leaf_count * sizeof(m_leaves[0]);
+    for (int i = 0; i < m_leaf_count; ++i) {
+        if (m_leaves[i].load(std::memory_order_relaxed) != NULL) {
+            bytes += CONN_TABLE_LEAF * sizeof(std::atomic<http_conn *>);
+        }
+    }
+    return bytes;
+}
+
+conn_slab::conn_slab() : m_capacity(0) {}
+
+conn_slab::~conn_slab() {
+    for (size_t i = 0; i < m_pages.size(); ++i) {
+        delete[] m_pages[i];
+        delete[] m_cold_pages[i];
+    }
+}
+
+http_conn *conn_slab::alloc() {
+    if (m_free.empty()) {
+        http_conn *page = new http_conn[CONN_SLAB_PAGE];
+        http_conn::cold_data *cold = new http_conn::cold_data[CONN_SLAB_PAGE];
+        m_pages.push_back(page);
+        m_cold_pages.push_back(cold);
+        m_capacity += CONN_SLAB_PAGE;
+        // 倒序放入，先分配页中靠前的对象
+        for (int i = CONN_SLAB_PAGE - 1; i >= 0; --i) {
+            page[i].m_cold = &cold[i];
+            m_free.push_back(&page[i]);
+        }
+    }
+    http_conn *conn = m_free.back();
+    m_free.pop_back();
+    return conn;
+}
+
+void conn_slab::free(http_conn *conn) {
+    m_free.push_back(conn);
+}
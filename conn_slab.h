@@ -0,0 +1,69 @@
+#ifndef CONN_SLAB_H
+#define CONN_SLAB_H
+
+#include <stddef.h>
+
+#include <atomic>
+#include <vector>
+
+#include "http_conn.h"
+
+#define CONN_SLAB_PAGE 64    // slab每次向系统申请的连接对象个数
+#define CONN_TABLE_LEAF 256  // fd表每个叶子覆盖的fd个数
+
+// fd到连接对象的映射，两级表：顶层按fd的高位索引叶子，叶子在其中第一个fd被使用时才分配，
+// 内存随实际用到的fd范围增长，而不是一开始就为每个可能的fd准备一个连接对象。
+// fd在进程内唯一，所有reactor共用一张表；一个fd同一时刻只属于一个reactor，只有它读写对应的格子
+class conn_table {
+public:
+    explicit conn_table(int max_fd);
+    ~conn_table();
+
+    conn_table(const conn_table &) = delete;
+    conn_table &operator=(const conn_table &) = delete;
+
+    // fd必须已经set过，连接关闭后为NULL
+    http_conn *get(int fd) const {
+        std::atomic<http_conn *> *leaf = m_leaves[fd / CONN_TABLE_LEAF].load(std::memory_order_acquire);
+        return leaf[fd % CONN_TABLE_LEAF].load(std::memory_order_acquire);
+    }
+    void set(int fd, http_conn *conn);
+    // 已分配的叶子占用的字节数
+    size_t memory() const;
+
+private:
+    int m_leaf_count;
+    std::atomic<std::atomic<http_conn *> *> *m_leaves;
+};
+
+// 连接对象的slab分配器，每个reactor一个，只在reactor线程中使用
+// 对象按页(CONN_SLAB_PAGE个)向系统申请，关闭后放回空闲链表留给下一个连接，不归还给系统。
+// 一页中的热数据紧挨着存放，冷数据在另一块内存中，每个对象指向自己的那一份。
+// 页由reactor线程申请并首次写入，绑核时落在reactor所在CPU的NUMA节点上
+class conn_slab {
+public:
+    conn_slab();
+    ~conn_slab();
+
+    conn_slab(const conn_slab &) = delete;
+    conn_slab &operator=(const conn_slab &) = delete;
+
+    http_conn *alloc();
+    void free(http_conn *conn);
+
+    // 正在使用的对象个数和已申请的对象个数
+    size_t live() const {
+        return m_capacity - m_free.size();
+    }
+    size_t capacity() const {
+        return m_capacity;
+    }
+
+private:
+    std::vector<http_conn *> m_pages;
+    std::vector<http_conn::cold_data *> m_cold_pages;  // 与m_pages一一对应的冷数据
+    std::vector<http_conn *> m_free;  // 空闲对象，后进先出，刚释放的对象还在缓存中
+    size_t m_capacity;
+};
+
+#endif
@@ -0,0 +1,108 @@
+#include "cpu_affinity.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+bool parse_cpu_list(const char *s, std::vector<int> &cpus) {
+    cpus.clear();
+    while (*s) {
+        char *end;
+        long first = strtol(s, &end, 10);
+        if (end == s || first < 0) {
+            return false;
+        }
+        long last = first;
+        s = end;
+        if (*s == '-') {
+            last = strtol(s + 1, &end, 10);
+            if (end == s + 1 || last < first) {
+                return false;
+            }
+            s = end;
+        }
+        if (last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long c = first; c <= last; ++c) {
+            cpus.push_back((int)c);
+        }
+        if (*s == ',') {
+            ++s;
+        } else if (*s != '\0') {
+            return false;
+        }
+    }
+    return !cpus.empty();
+}
+
+int cpu_node(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+    DIR *dir = opendir(path);
+    if (dir == NULL) {
+        return -1;
+    }
+    int node = -1;
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+        if (strncmp(ent->d_name, "node", 4) == 0 && ent->d_name[4] >= '0' &&
+            ent->d_name[4] <= '9') {
+            node = atoi(ent->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+bool set_thread_cpus(const std::vector<int> &cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (size_t i = 0; i < cpus.size(); ++i) {
+        CPU_SET(cpus[i], &set);
+    }
+    // pthread函数通过返回值报告错误，放进errno里方便调用者perror
+    int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+    if (ret != 0) {
+        errno = ret;
+        return false;
+    }
+    return true;
+}
+
+int create_pinned_thread(pthread_t *thread, int cpu, void *(*routine)(void *), void *arg) {
+    if (cpu < 0) {
+        return pthread_create(thread, NULL, routine, arg);
+    }
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    int ret = pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+    if (ret == 0) {
+        ret = pthread_create(thread, &attr, routine, arg);
+    }
+    pthread_attr_destroy(&attr);
+    return ret;
+}
+
+cpu_scope::cpu_scope(int cpu) : m_pinned(false) {
+    if (cpu < 0 || pthread_getaffinity_np(pthread_self(), sizeof(m_saved), &m_saved) != 0) {
+        return;
+    }
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    // 设置成功后线程立即迁移到该CPU上，之后的首次写入都发生在这里
+    m_pinned = pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+cpu_scope::~cpu_scope() {
+    if (m_pinned) {
+        pthread_setaffinity_np(pthread_self(), sizeof(m_saved), &m_saved);
+    }
+}
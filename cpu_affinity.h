@@ -0,0 +1,40 @@
+#ifndef CPU_AFFINITY_H
+#define CPU_AFFINITY_H
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <vector>
+
+// 线程绑核和NUMA本地分配的辅助函数，不依赖libnuma
+// Linux默认的内存策略是"首次访问"：页面在第一次被写入时才分配，放在当时执行写入的CPU所在的NUMA节点上。
+// 因此只要在目标CPU上创建并初始化对象，对象的内存就落在该CPU的本地节点上
+
+// 解析CPU列表，格式同taskset -c，例如"0-3,8,10-11"，有误时返回false
+bool parse_cpu_list(const char *s, std::vector<int> &cpus);
+
+// CPU所在的NUMA节点，从/sys/devices/system/cpu/cpuN/nodeM读取，不可知时返回-1
+int cpu_node(int cpu);
+
+// 把当前线程限制在cpus中的任意CPU上运行，之后创建的线程会继承这个掩码
+bool set_thread_cpus(const std::vector<int> &cpus);
+
+// 创建线程，cpu不小于0时线程从第一条指令起就绑定在该CPU上，线程栈也因此分配在本地节点
+int create_pinned_thread(pthread_t *thread, int cpu, void *(*routine)(void *), void *arg);
+
+// 在作用域内把当前线程临时绑定到cpu上，离开时恢复原来的掩码；cpu小于0时什么都不做
+// 在作用域内首次写入的内存会分配在cpu的本地节点上
+class cpu_scope {
+public:
+    explicit cpu_scope(int cpu);
+    ~cpu_scope();
+
+    cpu_scope(const cpu_scope &) = delete;
+    cpu_scope &operator=(const cpu_scope &) = delete;
+
+private:
+    bool m_pinned;
+    cpu_set_t m_saved;
+};
+
+#endif
@@ -0,0 +1,300 @@
+#include "epoll_reactor.h"
+
+#include <errno.h>
+#include <unistd.h>
+
+#include <cstdio>
+
+#include "log.h"
+
+// 添加文件描述符到epoll中，data为make_data()编码的fd和连接的代数
+static void addfd(int epollfd, int fd, uint64_t data, bool oneshot, bool et) {
+    epoll_event event;
+    event.data.u64 = data;
+
+    event.events = EPOLLIN | EPOLLRDHUP;  // 水平触发模式 LT
+
+    if (et) {
+        event.events |= EPOLLET;
+    }
+
+    // 即使设置了边沿触发 ET，也会出现一个socket上的事件多次触发。
+    // 比如，本来读完了数据开始处理，但是又有数据发来，这会导致又一个线程被唤醒来处理，
+    // 导致两个线程处理同一socket。
+    // 为了解决这个问题，可以设置EPOLLONESHOT
+    // 一言一概之：保证同一个socket只能被一个线程处理，不会跨越多个线程
+    if (oneshot) {
+        event.events |= EPOLLONESHOT;
+    }
+
+    // 向epoll注册该事件
+    // fd在创建时(socket/accept4)就已经是非阻塞的，这里不再调用fcntl
+    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
+}
+
+// 从epoll中删除文件描述符，fd由调用者关闭
+static void removefd(int epollfd, int fd) {
+    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
+}
+
+// 修改文件描述符 重置EPOLLONESHOT，确保下一次能触发
+static void modfd(int epollfd, int fd, uint64_t data, int ev, int et) {
+    epoll_event event;
+    event.data.u64 = data;
+    event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
+
+    if (et) {
+        event.events |= EPOLLET;
+    }
+    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+}
+
+epoll_reactor::epoll_reactor(int id, const server_config &cfg, conn_table *conns,
+                             threadpool<http_conn> *pool)
+    : reactor(id, cfg, conns, pool),
+      m_epollfd(-1),
+      m_loop_thread(pthread_self()),
+      m_states(MAX_FD) {}
+
+epoll_reactor::~epoll_reactor() {
+    if (m_epollfd != -1) {
+        close(m_epollfd);
+    }
+}
+
+bool epoll_reactor::init() {
+    if (!reactor::init()) {
+        return false;
+    }
+
+    // epoll注册
+    m_epollfd = epoll_create(5);  // 自一次Linux内核改动后，参数size就被忽略了，只需要比0大即可
+    if (m_epollfd == -1) {
+        perror("epoll_create");
+        return false;
+    }
+
+    // 将监听的文件描述符添加到epoll中
+    // 监听socket固定使用LT模式：每次只accept一批，剩下的连接在下一轮epoll_wait时还会通知
+    addfd(m_epollfd, m_listenfd, make_data(m_listenfd, 0), false, false);
+    // 监听timerfd、eventfd和signalfd，它们每次都会被读空，使用LT模式即可
+    addfd(m_epollfd, m_timerfd, make_data(m_timerfd, 0), false, false);
+    addfd(m_epollfd, m_wakefd, make_data(m_wakefd, 0), false, false);
+    if (m_sigfd != -1) {
+        addfd(m_epollfd, m_sigfd, make_data(m_sigfd, 0), false, false);
+    }
+    return true;
+}
+
+void epoll_reactor::rearm(http_conn *conn, int ev) {
+    int fd = conn->m_sockfd;
+    if (in_loop()) {
+        modfd(m_epollfd, fd, make_data(fd, m_states[fd].gen), ev, conn->m_et);
+        return;
+    }
+    // 工作线程处理完毕，把连接交还给reactor线程，交还之后不能再访问连接
+    m_notify_lock.lock();
+    bool wake = m_notify.empty();
+    notify_item item = {fd, ev};
+    m_notify.push_back(item);
+    m_notify_lock.unlock();
+    if (wake) {
+        uint64_t one = 1;
+        ::write(m_wakefd, &one, sizeof(one));
+    }
+}
+
+bool epoll_reactor::remove(http_conn *conn) {
+    int fd = conn->m_sockfd;
+    if (!in_loop()) {
+        rearm(conn, 0);
+        return false;
+    }
+    conn_state &st = m_states[fd];
+    if (st.busy) {
+        st.close_pending = true;
+        return false;
+    }
+    removefd(m_epollfd, fd);
+    // 本轮epoll_wait返回的事件中可能还有这个连接的，之后因代数不同而被丢弃
+    ++st.gen;
+    st.close_pending = false;
+    // fd关闭之前清空连接表中的格子，fd被复用后由accept它的reactor重新填上
+    m_conns->set(fd, NULL);
+    return true;
+}
+
+void epoll_reactor::reject(int sockfd) {
+    // 连接没有交给工作线程，恢复空闲才能正常关闭
+    m_states[sockfd].busy = false;
+    reactor::reject(sockfd);
+}
+
+// 批量接受新连接
+// accept4直接得到非阻塞的socket，省去每个连接两次fcntl；
+// 每次最多接受ACCEPT_BATCH个，避免连接风暴时长时间占住reactor而饿死已有连接的读写
+void epoll_reactor::deal_listen() {
+    struct sockaddr_in client_addr;
+    socklen_t client_addr_size;
+
+    for (int i = 0; i < ACCEPT_BATCH; ++i) {
+        client_addr_size = sizeof(client_addr);
+        int connfd = accept4(m_listenfd, (struct sockaddr *)&client_addr, &client_addr_size,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (connfd == -1) {
+            // 全连接队列已经取空
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+                LOG_ERROR("%s:errno is:%d", "accept error", errno);
+            }
+            break;
+        }
+        if (!add_conn(connfd, client_addr)) {
+            break;
+        }
+        conn_state &st = m_states[connfd];
+        st.busy = false;
+        st.close_pending = false;
+        // 添加到epoll对象中
+        addfd(m_epollfd, connfd, make_data(connfd, st.gen), true, true);
+    }
+}
+
+void epoll_reactor::deal_read(int sockfd) {
+    // 读取到完整请求
+    if (conn(sockfd)->read()) {
+        dispatch(sockfd);
+    }
+    // 读取失败，或对方关闭连接，则结束该用户
+    else {
+        close_timer(sockfd);
+    }
+}
+
+// 处理读缓冲区中的请求
+// 开启快速路径时先在本线程中处理：响应缓存命中的立即发送，不必等下一轮EPOLLOUT，
+// 发完后流水线上还有留下的请求就接着处理；请求不完整的继续接收
+void epoll_reactor::dispatch(int sockfd) {
+    http_conn *user = conn(sockfd);
+    while (true) {
+        refresh_timer(sockfd, user->reading_body() ? TIMEOUT_BODY : TIMEOUT_HEADER);
+        if (!m_cfg.inline_hits || !user->process_inline()) {
+            // 添加进线程池任务队列，本轮事件处理完后一起投递，交还之前连接归工作线程所有
+            m_states[sockfd].busy = true;
+            queue_task(sockfd);
+            return;
+        }
+        if (user->get_bytes_to_send() == 0) {
+            rearm(user, EPOLLIN);
+            return;
+        }
+        if (!send_response(sockfd)) {
+            return;
+        }
+    }
+}
+
+// 发送响应，返回true表示这一批已经发完，并且还有流水线上留下的请求要处理
+bool epoll_reactor::send_response(int sockfd) {
+    http_conn *user = conn(sockfd);
+    // 成功写入，响应还没发完则按发送超时计时，发完了则等待下一个请求
+    if (user->write()) {
+        refresh_timer(sockfd, user->get_bytes_to_send() > 0 ? TIMEOUT_WRITE : TIMEOUT_IDLE);
+        return user->get_bytes_to_send() == 0 && user->has_pending();
+    }
+    // 写入失败
+    close_timer(sockfd);
+    return false;
+}
+
+// 这个写入事件是由工作线程处理完之后反馈给我们的
+void epoll_reactor::deal_write(int sockfd) {
+    if (send_response(sockfd)) {
+        dispatch(sockfd);
+    }
+}
+
+void epoll_reactor::deal_notify(int fd, int ev) {
+    conn_state &st = m_states[fd];
+    st.busy = false;
+    if (ev == 0) {
+        // 工作线程要求关闭
+        close_timer(fd);
+    } else if (st.close_pending) {
+        // 处理期间超时或者出错，定时器已经移除，关闭后即可释放
+        http_conn *user = conn(fd);
+        user->close_conn();
+        release_conn(user);
+    } else {
+        rearm(conn(fd), ev);
+    }
+}
+
+void epoll_reactor::handle_notify() {
+    deal_wakeup();
+
+    m_notify_lock.lock();
+    m_handling.swap(m_notify);
+    m_notify_lock.unlock();
+
+    for (size_t i = 0; i < m_handling.size(); ++i) {
+        deal_notify(m_handling[i].fd, m_handling[i].ev);
+    }
+    m_handling.clear();
+}
+
+void epoll_reactor::loop() {
+    m_loop_thread = pthread_self();
+
+    while (!m_stop) {
+        // 等待epoll上的事件发生，超时由timerfd通知，因此可以无限期等待
+        // 返回I/O准备就绪的fd的数量
+        int num = epoll_wait(m_epollfd, m_events, MAX_EVENT_NUM, -1);
+        // 信号都由signalfd接收，正常情况下不会再被打断，但被调试器暂停等情况仍可能返回EINTR
+        if (num < 0 && errno != EINTR) {
+            LOG_ERROR("%s", "epoll failure");
+            break;
+        }
+        update_time();
+
+        // 循环遍历事件数组
+        for (int i = 0; i < num; ++i) {
+            uint64_t data = m_events[i].data.u64;
+            int sockfd = (int)(uint32_t)data;
+            unsigned gen = data >> 32;
+            // 有客户端连接进来
+            if (sockfd == m_listenfd) {
+                deal_listen();
+            }
+            // 有连接的超时时间到了
+            else if (sockfd == m_timerfd) {
+                deal_timer();
+            }
+            // 被其他线程唤醒：工作线程交还连接，或者要检查m_stop
+            else if (sockfd == m_wakefd) {
+                handle_notify();
+            }
+            // 收到退出信号
+            else if (sockfd == m_sigfd) {
+                deal_signal();
+            }
+            // 连接已经在本轮先前的事件中关闭，这是旧连接的事件
+            else if (gen != m_states[sockfd].gen) {
+                continue;
+            }
+            // 对方异常断开或错误事件
+            else if (m_events[i].events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                close_timer(sockfd);
+            }
+            // 监听到有读事件发生
+            else if (m_events[i].events & EPOLLIN) {
+                deal_read(sockfd);
+            }
+            // 监听到写事件发生
+            else if (m_events[i].events & EPOLLOUT) {
+                deal_write(sockfd);
+            }
+        }
+        flush_tasks();
+        after_loop();
+    }
+}
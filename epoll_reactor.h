@@ -0,0 +1,74 @@
+#ifndef EPOLL_REACTOR_H
+#define EPOLL_REACTOR_H
+
+#include <stdint.h>
+#include <sys/epoll.h>
+
+#include <vector>
+
+#include "locker.h"
+#include "reactor.h"
+
+#define ACCEPT_BATCH 64  // 监听socket每次可读时最多accept的连接数
+
+// 基于epoll的事件后端：就绪通知模型
+// reactor线程在fd就绪后负责accept/recv/writev，工作线程通过EPOLLONESHOT独占连接。
+// 连接交给工作线程后由它独占，期间超时或出错只记下要关闭；工作线程处理完毕后
+// 通过唤醒用的eventfd把连接交还给reactor线程，由reactor重新注册事件或者关闭
+class epoll_reactor : public reactor {
+public:
+    epoll_reactor(int id, const server_config &cfg, conn_table *conns,
+                  threadpool<http_conn> *pool);
+    ~epoll_reactor();
+
+    bool init();
+    void loop();
+    void rearm(http_conn *conn, int ev);
+    bool remove(http_conn *conn);
+
+protected:
+    void reject(int sockfd);
+
+private:
+    // 每个连接在epoll上的状态
+    struct conn_state {
+        unsigned gen;        // 连接的代数，fd被复用后同一批中旧连接的事件据此丢弃
+        bool busy;           // 连接已交给工作线程，交还之前不能关闭
+        bool close_pending;  // 忙碌期间被要求关闭，交还后再关闭
+    };
+    // 工作线程交还给reactor的连接，ev为EPOLLIN/EPOLLOUT，0表示关闭
+    struct notify_item {
+        int fd;
+        int ev;
+    };
+
+    // epoll_event中带上fd和连接的代数
+    static uint64_t make_data(int fd, unsigned gen) {
+        return ((uint64_t)gen << 32) | (uint32_t)fd;
+    }
+    bool in_loop() const {
+        return pthread_equal(pthread_self(), m_loop_thread);
+    }
+
+    void deal_listen();           // 接受新连接
+    void deal_read(int sockfd);   // 处理读事件
+    void deal_write(int sockfd);  // 处理写事件
+    // 处理读缓冲区中的请求：响应缓存命中的在本线程中处理并发送，其余的交给线程池
+    void dispatch(int sockfd);
+    bool send_response(int sockfd);  // 发送响应，返回是否还有流水线上的请求要接着处理
+    void handle_notify();            // 处理工作线程交还的连接
+    void deal_notify(int fd, int ev);
+
+private:
+    int m_epollfd;  // 本reactor独占的epoll实例
+    epoll_event m_events[MAX_EVENT_NUM];
+
+    pthread_t m_loop_thread;           // 事件循环所在线程
+    std::vector<conn_state> m_states;  // 下标为fd
+
+    locker m_notify_lock;                 // 保护m_notify
+    std::vector<notify_item> m_notify;    // 工作线程交还的连接
+    std::vector<notify_item> m_handling;  // reactor线程正在处理的交还连接
+};
+
+#endif
@@ -0,0 +1,356 @@
+#include "file_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "locker.h"
+
+namespace {
+
+struct shard {
+    locker lock;
+    // 键指向条目自己的path，查找时不需要构造std::string
+    std::unordered_map<std::string_view, file_entry *> map;
+    file_entry *head = NULL;  // LRU链表，头部最近使用，尾部最先淘汰
+    file_entry *tail = NULL;
+    size_t bytes = 0;           // 缓存中的条目占用的字节数
+    size_t response_bytes = 0;  // 其中完整响应占用的字节数
+    std::atomic<size_t> hits{0};
+    std::atomic<size_t> misses{0};
+    std::atomic<size_t> response_hits{0};
+    std::atomic<size_t> response_misses{0};
+
+    // 进程退出时连接都已关闭，缓存持有的是最后一个引用
+    ~shard() {
+        while (head != NULL) {
+            file_entry *e = head;
+            head = e->next;
+            file_cache::release(e);
+        }
+    }
+};
+
+shard g_shards[FILE_CACHE_SHARDS];
+size_t g_shard_bytes = 64 * 1024 * 1024 / FILE_CACHE_SHARDS;  // 每个分片的字节上限
+size_t g_shard_entries = 1024 / FILE_CACHE_SHARDS;            // 每个分片的条目上限，0表示不缓存
+long long g_revalidate_ms = 1000;
+size_t g_response_limit = 65536;
+size_t g_map_limit = 65536;
+
+shard &shard_of(std::string_view key) {
+    return g_shards[std::hash<std::string_view>()(key) % FILE_CACHE_SHARDS];
+}
+
+long long now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// 文件是否还是打开时的那一个，并且内容和权限都没变
+bool same_file(const struct stat &a, const struct stat &b) {
+    return a.st_ino == b.st_ino && a.st_dev == b.st_dev && a.st_size == b.st_size &&
+           a.st_mode == b.st_mode && a.st_mtim.tv_sec == b.st_mtim.tv_sec &&
+           a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+void lru_unlink(shard &s, file_entry *e) {
+    if (e->prev) {
+        e->prev->next = e->next;
+    } else {
+        s.head = e->next;
+    }
+    if (e->next) {
+        e->next->prev = e->prev;
+    } else {
+        s.tail = e->prev;
+    }
+    e->prev = e->next = NULL;
+}
+
+void lru_push_front(shard &s, file_entry *e) {
+    e->prev = NULL;
+    e->next = s.head;
+    if (s.head) {
+        s.head->prev = e;
+    } else {
+        s.tail = e;
+    }
+    s.head = e;
+}
+
+size_t response_bytes(const file_entry *e) {
+    return e->response[0] != NULL ? e->response_len[0] + e->response_len[1] : 0;
+}
+
+// 条目占用的内存，只打开不映射的大文件不计
+size_t cost(const file_entry *e) {
+    return (e->addr != NULL ? e->st.st_size : 0) + response_bytes(e);
+}
+
+// 从缓存中摘下条目，缓存持有的引用由调用者在解锁后释放
+void remove(shard &s, file_entry *e) {
+    s.map.erase(std::string_view(e->path));
+    lru_unlink(s, e);
+    s.bytes -= cost(e);
+    s.response_bytes -= response_bytes(e);
+    e->cached = false;
+}
+
+// 读入整个文件，生成两种Connection头的完整响应，格式与http_conn::process_write的输出相同
+bool build_response(file_entry *e) {
+    size_t size = e->st.st_size;
+    static const char *linger[2] = {"close", "keep-alive"};
+    for (int i = 0; i < 2; ++i) {
+        char head[200];
+        int n = snprintf(head, sizeof(head), "HTTP/1.1 200 OK\r\n%sConnection: %s\r\n\r\n",
+                         e->headers, linger[i]);
+        e->response[i] = new char[n + size];
+        e->response_len[i] = n + size;
+        memcpy(e->response[i], head, n);
+    }
+    // 文件内容只读一次，另一份从第一份拷贝
+    char *body = e->response[0] + (e->response_len[0] - size);
+    size_t done = 0;
+    while (done < size) {
+        ssize_t n = pread(e->fd, body + done, size - done, done);
+        if (n <= 0) {
+            return false;  // 文件在读取期间被截短
+        }
+        done += n;
+    }
+    memcpy(e->response[1] + (e->response_len[1] - size), body, size);
+    return true;
+}
+
+void free_entry(file_entry *e) {
+    if (e->addr != NULL) {
+        munmap(e->addr, e->st.st_size);
+    }
+    if (e->fd != -1) {
+        close(e->fd);
+    }
+    delete[] e->response[0];
+    delete[] e->response[1];
+    delete e;
+}
+
+// 打开文件，检查的顺序与原来的stat之后的判断一致，再按大小生成完整响应或者映射
+file_entry *load(const char *path, int &err) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err = errno;
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        err = errno;
+        close(fd);
+        return NULL;
+    }
+    // 判断访问权限  是否有其他人读取权限（read by others）
+    if (!(st.st_mode & S_IROTH)) {
+        err = EACCES;
+        close(fd);
+        return NULL;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        err = EISDIR;
+        close(fd);
+        return NULL;
+    }
+    file_entry *e = new file_entry;
+    e->refs.store(1, std::memory_order_relaxed);
+    e->fd = fd;
+    e->addr = NULL;
+    e->st = st;
+    e->headers_len = snprintf(e->headers, sizeof(e->headers),
+                              "Content-Length: %lld\r\nContent-Type:text/html\r\n",
+                              (long long)st.st_size);
+    e->response[0] = e->response[1] = NULL;
+    e->response_len[0] = e->response_len[1] = 0;
+    e->path = path;
+    e->checked = now_ms();
+    e->cached = false;
+    e->prev = e->next = NULL;
+
+    // 空文件由http_conn生成一个空页面，不做处理
+    size_t size = st.st_size;
+    if (size > 0 && size < g_response_limit) {
+        // 响应生成后就不再需要这个文件了，不占用fd
+        bool ok = build_response(e);
+        close(e->fd);
+        e->fd = -1;
+        if (!ok) {
+            err = EIO;
+            free_entry(e);
+            return NULL;
+        }
+    } else if (size > 0 && size < g_map_limit) {
+        e->addr = (char *)mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (e->addr == MAP_FAILED) {
+            err = errno;
+            e->addr = NULL;
+            free_entry(e);
+            return NULL;
+        }
+    }
+    return e;
+}
+
+}  // namespace
+
+void file_cache::init(size_t max_bytes, int max_entries, int revalidate_ms, size_t response_limit,
+                      size_t map_limit) {
+    g_shard_bytes = max_bytes / FILE_CACHE_SHARDS;
+    // 条目数不足分片数时每个分片至少缓存一个
+    g_shard_entries =
+        max_entries <= 0 ? 0 : (max_entries + FILE_CACHE_SHARDS - 1) / FILE_CACHE_SHARDS;
+    g_revalidate_ms = revalidate_ms;
+    g_response_limit = response_limit;
+    g_map_limit = map_limit;
+}
+
+file_entry *file_cache::acquire(const char *path, int &err) {
+    std::string_view key(path);
+    shard &s = shard_of(key);
+    long long now = now_ms();
+
+    s.lock.lock();
+    auto it = s.map.find(key);
+    if (it != s.map.end()) {
+        file_entry *e = it->second;
+        e->refs.fetch_add(1, std::memory_order_relaxed);
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+        if (now - e->checked < g_revalidate_ms) {
+            s.lock.unlock();
+            s.hits.fetch_add(1, std::memory_order_relaxed);
+            if (e->response[0] != NULL) {
+                s.response_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            return e;
+        }
+        // 到了校验时间，先记下时间再解锁去stat，其他线程在此期间照常使用旧条目
+        e->checked = now;
+        s.lock.unlock();
+
+        struct stat st;
+        if (stat(path, &st) == 0 && same_file(e->st, st)) {
+            s.hits.fetch_add(1, std::memory_order_relaxed);
+            if (e->response[0] != NULL) {
+                s.response_hits.fetch_add(1, std::memory_order_relaxed);
+            }
+            return e;
+        }
+        // 文件已变化，丢弃旧条目，再按未命中处理
+        bool drop = false;
+        s.lock.lock();
+        if (e->cached) {
+            remove(s, e);
+            drop = true;
+        }
+        s.lock.unlock();
+        if (drop) {
+            release(e);
+        }
+        release(e);
+    } else {
+        s.lock.unlock();
+    }
+
+    s.misses.fetch_add(1, std::memory_order_relaxed);
+    file_entry *e = load(path, err);
+    if (e != NULL && e->response[0] != NULL) {
+        s.response_misses.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (e == NULL || g_shard_entries == 0 || cost(e) > g_shard_bytes) {
+        return e;  // 不缓存，调用者释放时即关闭
+    }
+
+    // 插入缓存，超出上限时从LRU尾部淘汰；淘汰的条目在解锁后再释放，munmap不在锁内进行
+    std::vector<file_entry *> evicted;
+    s.lock.lock();
+    if (s.map.find(key) == s.map.end()) {
+        e->refs.fetch_add(1, std::memory_order_relaxed);
+        e->cached = true;
+        s.map.emplace(std::string_view(e->path), e);
+        lru_push_front(s, e);
+        s.bytes += cost(e);
+        s.response_bytes += response_bytes(e);
+        while (s.tail != e && (s.bytes > g_shard_bytes || s.map.size() > g_shard_entries)) {
+            file_entry *victim = s.tail;
+            remove(s, victim);
+            evicted.push_back(victim);
+        }
+    }
+    // 否则其他线程刚刚插入了同一个文件，这个条目只给本次请求使用
+    s.lock.unlock();
+    for (size_t i = 0; i < evicted.size(); ++i) {
+        release(evicted[i]);
+    }
+    return e;
+}
+
+file_entry *file_cache::lookup(const char *path) {
+    std::string_view key(path);
+    shard &s = shard_of(key);
+    long long now = now_ms();
+    file_entry *e = NULL;
+
+    s.lock.lock();
+    auto it = s.map.find(key);
+    if (it != s.map.end() && it->second->response[0] != NULL &&
+        now - it->second->checked < g_revalidate_ms) {
+        e = it->second;
+        e->refs.fetch_add(1, std::memory_order_relaxed);
+        lru_unlink(s, e);
+        lru_push_front(s, e);
+    }
+    s.lock.unlock();
+    if (e != NULL) {
+        s.hits.fetch_add(1, std::memory_order_relaxed);
+        s.response_hits.fetch_add(1, std::memory_order_relaxed);
+    }
+    return e;
+}
+
+void file_cache::release(file_entry *e) {
+    if (e->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        free_entry(e);
+    }
+}
+
+void file_cache::stats(size_t &entries, size_t &bytes, size_t &hits, size_t &misses) {
+    entries = bytes = hits = misses = 0;
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i) {
+        shard &s = g_shards[i];
+        s.lock.lock();
+        entries += s.map.size();
+        bytes += s.bytes;
+        s.lock.unlock();
+        hits += s.hits.load(std::memory_order_relaxed);
+        misses += s.misses.load(std::memory_order_relaxed);
+    }
+}
+
+void file_cache::response_stats(size_t &bytes, size_t &hits, size_t &misses) {
+    bytes = hits = misses = 0;
+    for (int i = 0; i < FILE_CACHE_SHARDS; ++i) {
+        shard &s = g_shards[i];
+        s.lock.lock();
+        bytes += s.response_bytes;
+        s.lock.unlock();
+        hits += s.response_hits.load(std::memory_order_relaxed);
+        misses += s.response_misses.load(std::memory_order_relaxed);
+    }
+}
@@ -0,0 +1,61 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <stddef.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <string>
+
+#define FILE_CACHE_SHARDS 16  // 缓存分片数，每个分片一把锁
+
+// 一个打开并映射好的静态文件，由引用计数管理
+// 缓存持有一个引用，每个正在发送它的连接各持有一个，最后一个引用释放时才munmap和close
+struct file_entry {
+    std::atomic<int> refs;
+    int fd;             // 打开的文件，只读；整个响应都已生成的小文件为-1
+    char *addr;         // 整个文件的只读映射，只有中等大小的文件才有
+    struct stat st;     // 打开时的文件状态，用于重新校验
+    char headers[80];   // 预先生成的Content-Length和Content-Type两行
+    int headers_len;
+    // 小文件预先生成的完整响应(状态行、响应头和文件内容)，下标0为Connection: close，1为keep-alive
+    char *response[2];
+    int response_len[2];
+
+    // 以下由所在分片的锁保护
+    std::string path;
+    long long checked;  // 上次校验的时间，毫秒
+    bool cached;        // 是否还在缓存中
+    file_entry *prev;   // LRU链表，表头是最近用过的
+    file_entry *next;
+};
+
+// 静态文件的打开和映射缓存
+// 按路径的哈希分片，命中时不再stat、open、mmap，响应发送完也不再munmap；
+// 按文件大小分三档：小文件直接保存序列化好的完整响应，一次send发完；中等的文件映射到内存，
+// 与响应头一起writev；大文件只保留打开的fd，由sendfile/splice发送。
+// 每个分片按LRU淘汰，占用的内存(完整响应和映射)和条目数不超过设置的上限(平均分给各分片)，
+// 占用超过单个分片字节上限的条目不缓存。
+// 条目每隔一段时间用stat重新校验一次，文件被修改、替换或删除后丢弃旧条目，正在发送旧内容的连接不受影响
+class file_cache {
+public:
+    // max_entries为0时不缓存，每次都重新打开文件；revalidate_ms为0时每次命中都重新校验；
+    // 小于response_limit字节的文件生成完整响应，其余不小于map_limit字节的文件不做映射
+    static void init(size_t max_bytes, int max_entries, int revalidate_ms, size_t response_limit,
+                     size_t map_limit);
+
+    // 取得path对应的文件，返回的条目须用release归还；失败返回NULL，err为对应的errno：
+    // 不存在为ENOENT，不可读为EACCES，是目录为EISDIR
+    static file_entry *acquire(const char *path, int &err);
+    static void release(file_entry *e);
+    // 只在缓存中查找path对应的、已生成完整响应并且还不需要重新校验的条目，不stat也不打开文件，
+    // 供reactor线程直接发送；没有时返回NULL，由调用者改用acquire。返回的条目同样须用release归还
+    static file_entry *lookup(const char *path);
+
+    // 缓存的条目数、占用的字节数和累计的命中、未命中次数
+    static void stats(size_t &entries, size_t &bytes, size_t &hits, size_t &misses);
+    // 完整响应占用的字节数，以及小文件请求中直接使用已生成响应的次数和需要新生成的次数
+    static void response_stats(size_t &bytes, size_t &hits, size_t &misses);
+};
+
+#endif
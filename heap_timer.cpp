@@ -12,7 +12,7 @@ TimeHeap::TimeHeap(int capacity) : m_capacity(capacity), m_size(0) {
 }
 
 TimeHeap::TimeHeap(HeapTimer** timers, int size, int capacity)
-    : m_size(size), m_capacity(capacity) {
+    : m_capacity(capacity), m_size(size) {
     // 参数不对
     if (m_capacity < size) {
         throw std::exception();
@@ -28,6 +28,7 @@ TimeHeap::TimeHeap(HeapTimer** timers, int size, int capacity)
     // 拷贝
     for (int i = 0; i < size; i++) {
         m_timers[i] = timers[i];
+        m_timers[i]->index = i;
     }
 
     // 从最后一个节点的父节点开始遍历，下沉操作
@@ -36,12 +37,11 @@ TimeHeap::TimeHeap(HeapTimer** timers, int size, int capacity)
     }
 }
 
+// 堆被销毁时，删除其中所有的定时器
 TimeHeap::~TimeHeap() {
-    // for (int i = 0; i < m_size; i++) {
-    //     if (!m_timers[i]) {
-    //         delete m_timers[i];
-    //     }
-    // }
+    for (int i = 0; i < m_size; i++) {
+        delete m_timers[i];
+    }
     if (m_timers != nullptr) {
         delete[] m_timers;
     }
@@ -61,6 +61,7 @@ void TimeHeap::shift_down(int k) {
             m_timers[i]->index = k;
             m_timers[k] = m_timers[i];
             k = i;
+            i = k * 2 + 1;
         } else {
             // tmp节点的值最小，符合
             break;
@@ -71,6 +72,22 @@ void TimeHeap::shift_down(int k) {
     timer->index = k;
 }
 
+// 对堆结点进行上滤，父节点比它大就把父节点换下来
+void TimeHeap::shift_up(int k) {
+    HeapTimer* timer = m_timers[k];
+    while (k > 0) {
+        int parent = (k - 1) / 2;
+        if (m_timers[parent]->expire <= timer->expire) {
+            break;
+        }
+        m_timers[parent]->index = k;
+        m_timers[k] = m_timers[parent];
+        k = parent;
+    }
+    m_timers[k] = timer;
+    timer->index = k;
+}
+
 // 添加定时器，先放在数组末尾，在进行上滤使其满足最小堆
 void TimeHeap::add_timer(HeapTimer* timer) {
     if (timer == nullptr) {
@@ -82,52 +99,52 @@ void TimeHeap::add_timer(HeapTimer* timer) {
         reallocate();
     }
 
-    // 获取新节点下标
-    int i = m_size;
+    m_timers[m_size] = timer;
+    timer->index = m_size;
     ++m_size;
+    shift_up(timer->index);
+}
 
-    // 父节点
-    int parent = (i - 1) / 2;
-
-    // 父节点就是它自己，说明它是第一个元素，直接放入
-    if (i == parent) {
-        m_timers[i] = timer;
-        timer->index = i;
+void TimeHeap::remove_at(int k) {
+    HeapTimer* timer = m_timers[k];
+    --m_size;
+    timer->index = -1;
+    if (k == m_size) {
+        m_timers[m_size] = nullptr;
         return;
     }
-
-    // 由于新结点在最后，因此将其进行上滤，以符合最小堆
-    while (parent >= 0) {
-        if (m_timers[parent]->expire > timer->expire) {
-            m_timers[parent]->index = i;
-            m_timers[i] = m_timers[parent];
-            i = parent;
-        } else {
-            break;
-        }
+    // 用堆尾的定时器填补空位，它可能比原来的父节点小，也可能比子节点大
+    m_timers[k] = m_timers[m_size];
+    m_timers[k]->index = k;
+    m_timers[m_size] = nullptr;
+    if (k > 0 && m_timers[k]->expire < m_timers[(k - 1) / 2]->expire) {
+        shift_up(k);
+    } else {
+        shift_down(k);
     }
-    m_timers[i] = timer;
-    timer->index = i;
 }
 
-// 删除指定定时器
+// 删除指定定时器，直接从它所在的位置取出，不会在堆中留下无效的定时器
 void TimeHeap::del_timer(HeapTimer* timer) {
-    if (timer == nullptr) {
+    if (timer == nullptr || timer->index < 0) {
         return;
     }
-    // 仅仅将回调函数置空，虽然节省删除的开销，但会造成数组膨胀
-    timer->callback = nullptr;
+    remove_at(timer->index);
+    recycle(timer);
 }
 
 // 调整指定定时器在堆中的位置
 void TimeHeap::adjust_timer(HeapTimer* timer) {
-    if (timer == nullptr) {
+    if (timer == nullptr || timer->index < 0) {
         return;
     }
-
-    // 从timer所在位置进行一次下沉操作即可
-    shift_down(timer->index);
-    timer->callback = nullptr;
+    int k = timer->index;
+    // 超时时间缩短则上滤，延长则下滤
+    if (k > 0 && timer->expire < m_timers[(k - 1) / 2]->expire) {
+        shift_up(k);
+    } else {
+        shift_down(k);
+    }
 }
 
 // 删除堆顶定时器
@@ -135,41 +152,38 @@ void TimeHeap::pop_timer() {
     if (m_size <= 0) {
         return;
     }
-    if (m_timers[0] != nullptr) {
-        delete m_timers[0];
-        // 将最后一个定时器赋给堆顶
-        --m_size;
-        m_timers[m_size]->index = 0;
-        m_timers[0] = m_timers[m_size];
-
-        // 对新的根节点进行下滤，保证最小堆
-        shift_down(0);
-    }
+    HeapTimer* timer = m_timers[0];
+    remove_at(0);
+    // 定时器放回空闲链表，留给下一个连接复用
+    recycle(timer);
 }
 
 // 从时间堆中寻找到时间的结点
-void TimeHeap::tick() {
-    HeapTimer* timer = m_timers[0];
-    time_t cur = time(NULL);
-
+void TimeHeap::tick(long long now) {
     // 不断判断堆顶是否时间已到
     while (m_size > 0) {
-        if (timer == nullptr) {
-            break;
-        }
+        HeapTimer* timer = m_timers[0];
         // 未到时间，则停止
-        if (timer->expire > cur) {
+        if (timer->expire > now) {
             break;
         }
-        if (m_timers[0]->callback != nullptr) {
-            m_timers[0]->callback(m_timers[0]->user_data);
+        // 惰性刷新过的定时器还没有真正超时，改为新的超时时间后下滤即可
+        if (reschedule(timer, now)) {
+            shift_down(0);
+            continue;
         }
-        // 无论是否调用了callback，都会在调用结束后清除堆顶计时器
+        // 先把堆顶定时器取出并回收，再执行回调，回调中即使调整了其他定时器也不会影响堆的结构
+        void (*callback)(http_conn*) = timer->callback;
+        http_conn* user = timer->user_data;
         pop_timer();
-        timer = m_timers[0];
+        callback(user);
     }
 }
 
+long long TimeHeap::next_expire() const {
+    return m_size > 0 ? m_timers[0]->expire : -1;
+}
+
 // 空间不足时，将空间扩大为原来的2倍
 void TimeHeap::reallocate() {
     m_capacity *= 2;
@@ -181,6 +195,9 @@ void TimeHeap::reallocate() {
     for (int i = 0; i < m_size; i++) {
         timers[i] = m_timers[i];
     }
+    for (int i = m_size; i < m_capacity; i++) {
+        timers[i] = nullptr;
+    }
     if (m_timers != nullptr) {
         delete[] m_timers;
     }
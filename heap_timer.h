@@ -4,21 +4,15 @@
 #include <netinet/in.h>
 #include <time.h>
 
-#include "http_conn.h"
+#include "lst_timer.h"
 
-// 定时器类
-class HeapTimer {
-public:
-    time_t expire;         // 定时器生效的绝对时间
-    http_conn* user_data;  // 客户信息
-    int index;             // 对应于堆数组中的下标
+// 时间堆中的定时器就是util_timer，index记录它在堆数组中的下标，
+// 因此删除和调整任意定时器时不需要查找，直接从它所在的位置上滤或下滤
+typedef util_timer HeapTimer;
 
-public:
-    HeapTimer() {}
-    void (*callback)(http_conn*);  // 定时器的回调函数
-};
+// 以超时时间为键的最小堆，插入、删除、调整都是O(log n)，堆顶就是最早的超时时间
 // 仿照vector扩容机制实现堆数组
-class TimeHeap {
+class TimeHeap : public timer_queue {
 private:
     HeapTimer** m_timers;  // 堆数组，每个元素都是一个计时器指针
     int m_capacity;        // 堆数组容量
@@ -29,12 +23,19 @@ public:
     ~TimeHeap();
 
 public:
-    void shift_down(int hole);  // 对堆结点进行下虑
     void add_timer(HeapTimer* timer);
     void del_timer(HeapTimer* timer);
+    // 超时时间延长或缩短都可以，根据新的值上滤或下滤
     void adjust_timer(HeapTimer* timer);
-    void pop_timer();
-    void tick();
+    void tick(long long now);
+    long long next_expire() const;
+
+private:
+    void shift_down(int hole);  // 对堆结点进行下滤
+    void shift_up(int hole);    // 对堆结点进行上滤
+    // 把下标为k的定时器从堆中取出，用堆尾的定时器填补，不回收定时器
+    void remove_at(int k);
+    void pop_timer();  // 删除堆顶定时器，并将它回收复用
     // 当堆数组容量不够时，对其进行扩容
     void reallocate();
 };
@@ -0,0 +1,110 @@
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+#include <string.h>
+
+#include <atomic>
+
+// HDR风格的对数线性直方图：按最高位分成若干段，每段再平均分成16个子桶，
+// 任何数值的相对误差都不超过1/16，桶的个数固定，记录一次只需要几次位运算和一次加法
+enum {
+    HIST_SUB_BITS = 4,
+    HIST_SUB_COUNT = 1 << HIST_SUB_BITS,
+    HIST_MAX_BITS = 40,  // 纳秒计时可以记录到约18分钟，更大的值计入最后一个桶
+    HIST_BUCKETS = (HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB_COUNT
+};
+
+inline int hist_bucket(uint64_t v) {
+    if (v < HIST_SUB_COUNT) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    if (msb >= HIST_MAX_BITS) {
+        return HIST_BUCKETS - 1;
+    }
+    int shift = msb - HIST_SUB_BITS;
+    return (shift + 1) * HIST_SUB_COUNT + (int)((v >> shift) & (HIST_SUB_COUNT - 1));
+}
+
+// 桶中数值的上界
+inline uint64_t hist_bucket_value(int idx) {
+    if (idx < HIST_SUB_COUNT) {
+        return idx;
+    }
+    int shift = idx / HIST_SUB_COUNT - 1;
+    uint64_t sub = idx % HIST_SUB_COUNT;
+    return ((HIST_SUB_COUNT + sub + 1) << shift) - 1;
+}
+
+// 直方图某一时刻的拷贝，可以合并、相减，在其上计算分位数
+struct histogram_snapshot {
+    uint64_t counts[HIST_BUCKETS];
+    uint64_t total;
+
+    histogram_snapshot() {
+        clear();
+    }
+
+    void clear() {
+        memset(counts, 0, sizeof(counts));
+        total = 0;
+    }
+
+    // 减去更早的一份拷贝，得到这段时间内的分布
+    void subtract(const histogram_snapshot &prev) {
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+            counts[i] -= prev.counts[i];
+        }
+        total -= prev.total;
+    }
+
+    // q取0~1，没有数据时返回0
+    uint64_t percentile(double q) const {
+        if (total == 0) {
+            return 0;
+        }
+        uint64_t rank = (uint64_t)(q * total);
+        if (rank >= total) {
+            rank = total - 1;
+        }
+        uint64_t seen = 0;
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+            seen += counts[i];
+            if (seen > rank) {
+                return hist_bucket_value(i);
+            }
+        }
+        return hist_bucket_value(HIST_BUCKETS - 1);
+    }
+};
+
+// 只允许一个线程写入，其他线程可以随时读取。写入方没有竞争，
+// 因此用relaxed的读-加-写代替带lock前缀的原子加法，开销与普通的自增相同
+class latency_histogram {
+private:
+    std::atomic<uint64_t> m_counts[HIST_BUCKETS];
+
+public:
+    latency_histogram() {
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+            m_counts[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void record(uint64_t v) {
+        std::atomic<uint64_t> &c = m_counts[hist_bucket(v)];
+        c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // 累加到out中，多个线程的直方图合并成一份
+    void add_to(histogram_snapshot &out) const {
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+            uint64_t n = m_counts[i].load(std::memory_order_relaxed);
+            out.counts[i] += n;
+            out.total += n;
+        }
+    }
+};
+
+#endif
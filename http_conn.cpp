@@ -1,126 +1,194 @@
 #include "http_conn.h"
 
-int http_conn::m_epollfd = -1;    // 所有socket上的事件都被注册到同一个epoll中
-int http_conn::m_user_count = 0;  // 统计用户数量
-
-// 设置文件描述符非阻塞
-int setnonblocking(int fd) {
-    int flag = fcntl(fd, F_GETFL);
-    flag |= O_NONBLOCK;
-    return fcntl(fd, F_SETFL, flag);
-}
-
-// 添加文件描述符到epoll中
-void addfd(int epollfd, int fd, bool oneshot, bool et) {
-    epoll_event event;
-    event.data.fd = fd;
-
-    event.events = EPOLLIN | EPOLLRDHUP;  // 水平触发模式 LT
-
-    if (et) {
-        event.events |= EPOLLET;
+#include "buffer_pool.h"
+#include "char_scan.h"
+#include "reactor.h"
+
+std::atomic<int> http_conn::m_user_count(0);  // 统计用户数量
+int http_conn::m_max_read = BUF_CLASS_MAX;
+int http_conn::m_max_write = 16384;
+router http_conn::m_router;
+static_assert(http_conn::CONNECT < ROUTER_METHODS, "路由表按方法下标保存处理者");
+
+// 网站根目录
+static const char doc_root[] = "/home/echo/projects/cpp/WebServer/resources";
+
+// 定义HTTP响应的一些状态信息，所有连接共用一份
+static const char ok_200_title[] = "OK";
+static const char error_400_title[] = "Bad Request";
+static const char error_400_form[] =
+    "Your request has bad syntax or is inherently impossible to satisfy.\n";
+static const char error_403_title[] = "Forbidden";
+static const char error_403_form[] = "You do not have permission to get file from this server.\n";
+static const char error_404_title[] = "Not Found";
+static const char error_404_form[] = "The requested file was not found on this server.\n";
+static const char error_500_title[] = "Internal Error";
+static const char error_500_form[] = "There was an unusual problem serving the requested file.\n";
+
+// 把缓冲区换成下一级，保留前used个字节。已达上限limit时返回false
+static bool grow_buffer(char *&buf, int &cap, int used, int limit) {
+    if (cap >= limit) {
+        return false;
     }
-
-    // 即使设置了边沿触发 ET，也会出现一个socket上的事件多次触发。
-    // 比如，本来读完了数据开始处理，但是又有数据发来，这会导致又一个线程被唤醒来处理，
-    // 导致两个线程处理同一socket。
-    // 为了解决这个问题，可以设置EPOLLONESHOT
-    // 一言一概之：保证同一个socket只能被一个线程处理，不会跨越多个线程
-    if (oneshot) {
-        event.events |= EPOLLONESHOT;
+    int new_cap;
+    char *fresh = buffer_pool::acquire(cap + 1, new_cap);
+    if (fresh == NULL) {
+        return false;
     }
-
-    // 向epoll注册该事件
-    epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);
-
-    // 设置文件描述符非阻塞
-    setnonblocking(fd);
-}
-
-// 从epoll中删除文件描述符
-void removefd(int epollfd, int fd) {
-    epoll_ctl(epollfd, EPOLL_CTL_DEL, fd, NULL);
-    close(fd);
-}
-
-// 修改文件描述符 重置EPOLLONESHOT，确保下一次能触发
-void modfd(int epollfd, int fd, int ev, int et) {
-    epoll_event event;
-    event.data.fd = fd;
-    event.events = ev | EPOLLONESHOT | EPOLLRDHUP;
-
-    if (et) {
-        event.events |= EPOLLET;
+    if (buf != NULL) {
+        memcpy(fresh, buf, used);
+        buffer_pool::release(buf, cap);
     }
-    epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);
+    buf = fresh;
+    cap = new_cap;
+    return true;
 }
 
-// 初始化新建立的连接
-void http_conn::init(int sockfd, const sockaddr_in &addr, bool et, util_timer *timer) {
+// 初始化新建立的连接，连接的事件由所属的reactor负责注册
+void http_conn::init(int sockfd, const sockaddr_in &addr, bool et, reactor *r,
+                     util_timer *timer) {
     m_sockfd = sockfd;
-    m_address = addr;
+    m_reactor = r;
+    m_cold->address = addr;
     m_et = et;
     m_timer = timer;
 
-    // 设置端口复用
-    int reuse = 1;
-    int ret = setsockopt(sockfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
-    if (ret == -1) {
-        perror("setsockopt reuseport");
-        exit(-1);
-    }
-
-    // 添加到epoll对象中
-    addfd(m_epollfd, sockfd, true, true);
     m_user_count++;
     init();
 }
 
 // 初始化状态机
 void http_conn::init() {
-    m_check_state = CHECK_STATE_REQUESTLINE;  // 初始化主状态机状态为解析请求首行
-    m_checked_idx = 0;                        // 当前解析到的读缓冲区索引
-    m_start_line = 0;                         // 当前正在解析的行的起始位置
-    m_url = 0;                                // url初始置空
-    m_method = GET;                           // 方法初始为GET
-    m_version = 0;                            // httpversion初始为0
-    m_host = 0;                               // 主机名
-    m_linger = false;                         // http是否保持连接
-    m_content_length = 0;                     // 内容长度为0
+    reset_request();
+    m_sendfile = false;
+    m_keep_alive = false;
     m_write_idx = 0;
     m_read_idx = 0;
 
     bytes_have_send = 0;
     bytes_to_send = 0;
 
-    bzero(m_readbuf, READ_BUFFER_SIZE);  // 置空readbuf
-    bzero(m_write_buf, READ_BUFFER_SIZE);
-    bzero(m_real_file, FILENAME_LEN);
+    // 一个请求处理完了，空闲的连接不占用缓冲区，下一个请求到来时再取
+    release_buffers();
+    release_file();
+}
+
+void http_conn::reset_request() {
+    m_check_state = CHECK_STATE_REQUESTLINE;  // 初始化主状态机状态为解析请求首行
+    m_checked_idx = 0;                        // 当前解析到的读缓冲区索引
+    m_start_line = 0;                         // 当前正在解析的行的起始位置
+    m_linger = false;                         // http是否保持连接
+
+    // 冷数据中需要重置的字段都集中在它的开头，文件名和头部索引在使用时才写入
+    m_cold->url = 0;             // url初始置空
+    m_cold->method = GET;        // 方法初始为GET
+    m_cold->version = 0;         // httpversion初始为0
+    m_cold->content_length = 0;  // 内容长度为0
+    m_cold->parsed = NO_REQUEST;
+    m_cold->header_count = 0;
+    memset(m_cold->known, -1, sizeof(m_cold->known));
+    m_cold->chunked = false;
+    m_cold->body_len = 0;
+    m_cold->body_received = 0;
+    m_cold->handler = NULL;
+    m_cold->begun = false;
+    m_cold->rejected = NO_REQUEST;
+    m_cold->user_data = 0;
+    m_cold->param_count = 0;
+}
+
+// 请求到m_checked_idx为止，客户端不等响应就接着发来的请求(HTTP/1.1流水线)已经在它后面，
+// 挪到读缓冲区开头，头部索引中的偏移和m_checked_idx都从0开始；写缓冲区中这一批的响应不动
+void http_conn::next_request() {
+    int left = m_read_idx - m_checked_idx;
+    if (left > 0) {
+        memmove(m_readbuf, m_readbuf + m_checked_idx, left);
+    }
+    m_read_idx = left;
+    reset_request();
+}
+
+void http_conn::release_buffers() {
+    if (m_readbuf != NULL) {
+        buffer_pool::release(m_readbuf, m_read_cap);
+        m_readbuf = NULL;
+        m_read_cap = 0;
+    }
+    if (m_write_buf != NULL) {
+        buffer_pool::release(m_write_buf, m_write_cap);
+        m_write_buf = NULL;
+        m_write_cap = 0;
+    }
 }
+
+// 读缓冲区可用的大小，不超过上限
+static inline int usable(int cap, int limit) {
+    return cap < limit ? cap : limit;
+}
+
+// 多留一个字节，读缓冲区中的数据后面总有位置放结束符
+bool http_conn::reserve_read(int len) {
+    while (m_read_idx + len + 1 > usable(m_read_cap, m_max_read)) {
+        char *old = m_readbuf;
+        if (!grow_buffer(m_readbuf, m_read_cap, m_read_idx, m_max_read)) {
+            return false;
+        }
+        // 已经解析出的字段指向旧的缓冲区，跟着搬过去
+        if (old != NULL) {
+            // 头部索引中保存的是偏移，不用调整
+            char **fields[] = {&m_cold->url, &m_cold->version};
+            for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i) {
+                if (*fields[i] != NULL) {
+                    *fields[i] = m_readbuf + (*fields[i] - old);
+                }
+            }
+        }
+    }
+    return true;
+}
+// 同样多留一个字节给vsnprintf写入的结束符
+bool http_conn::reserve_write(int len) {
+    while (m_write_idx + len + 1 > usable(m_write_cap, m_max_write)) {
+        if (!grow_buffer(m_write_buf, m_write_cap, m_write_idx, m_max_write)) {
+            return false;
+        }
+    }
+    return true;
+}
+
 // 关闭连接
 void http_conn::close_conn() {
-    if (m_sockfd != -1) {
-        removefd(m_epollfd, m_sockfd);
+    // reactor返回false说明连接正被其他线程使用，reactor会在之后再次关闭它
+    if (m_sockfd != -1 && m_reactor->remove(this)) {
+        // 先清空m_sockfd再关闭fd：fd一旦关闭就可能被其他reactor accept并复用这个对象
+        int fd = m_sockfd;
         m_sockfd = -1;
         m_user_count--;
+        close(fd);
     }
 }
 
 // 一次性读完（非阻塞）
 // 循环读取数据，直到无数据可读或对方关闭连接
 bool http_conn::read() {
-    // 缓冲已满
-    if (m_read_idx >= READ_BUFFER_SIZE) {
-        return false;
+    // 缓冲区已满且达到上限，先处理已经收到的数据：交出请求体或者流水线上的请求后就有了空间，
+    // 否则请求过大，解析时回复400
+    if (!reserve_read(1)) {
+        return true;
     }
 
     // 已经读取到的字节
     int bytes = 0;
 
     if (m_et) {
-        // ET模式下，必须要把数据一次读完
+        // ET模式下，必须要把数据一次读完，缓冲区读满了就换更大的一级
         while (true) {
-            bytes = recv(m_sockfd, m_readbuf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+            // 没读完的数据在处理完后重新注册事件时还会通知
+            if (!reserve_read(1)) {
+                break;
+            }
+            int room = usable(m_read_cap, m_max_read) - 1 - m_read_idx;
+            bytes = recv(m_sockfd, m_readbuf + m_read_idx, room, 0);
             if (bytes == -1) {
                 if (errno == EAGAIN || errno == EWOULDBLOCK) {
                     // 没有数据
@@ -134,8 +202,9 @@ bool http_conn::read() {
             m_read_idx += bytes;  // 索引后移
         }
     } else {
-        // LT模式下，只用读一次即可
-        bytes = recv(m_sockfd, m_readbuf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        // LT模式下，只用读一次即可，没读完的数据下一轮还会通知
+        int room = usable(m_read_cap, m_max_read) - 1 - m_read_idx;
+        bytes = recv(m_sockfd, m_readbuf + m_read_idx, room, 0);
         m_read_idx += bytes;
 
         if (bytes <= 0) {
@@ -145,46 +214,55 @@ bool http_conn::read() {
     return true;
 }
 
+// 把事件后端收到的数据追加到读缓冲区，放不下时追加到缓冲区满为止，返回追加的字节数；
+// 读缓冲区满了解析时才能判断出请求过大
+int http_conn::append_read(const char *data, int len) {
+    reserve_read(len);
+    int room = usable(m_read_cap, m_max_read) - 1 - m_read_idx;
+    int n = len < room ? len : room;
+    if (n <= 0) {
+        return 0;
+    }
+    memcpy(m_readbuf + m_read_idx, data, n);
+    m_read_idx += n;
+    return n;
+}
+
 // 解析一行，根据\r\n判断
 http_conn::LINE_STATUS http_conn::parse_line() {
     // m_read_idx表示的是读缓冲区中读入的最后一个字符下标
     // m_checked_idx表示的是当前正在解析的字符的下标
 
-    // 当前字符
-    char ch;
-
-    // 一个字符一个字符地遍历，直到读缓冲区中最后一个字符
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
-        // 获取当前字符
-        ch = m_readbuf[m_checked_idx];
-
-        // 如果是\r，判断下一个是不是\n
-        if (ch == '\r') {
-            // m_checked_idx已经是读入的最后一个字符了
-            if (m_checked_idx + 1 == m_read_idx) {
-                return LINE_OPEN;  // 行数据还不完整
-            } else if (m_readbuf[m_checked_idx + 1] == '\n') {
-                m_readbuf[m_checked_idx++] = '\0';  // \r变成字符串分隔符
-                m_readbuf[m_checked_idx++] = '\0';  // \n变成字符串分隔符
-                return LINE_OK;                     // 行解析成功
-            }
-            return LINE_BAD;  // 只有\r说明行出错
-        }
-        // 这种情况出现说明是上面行数据不完整，之前可能解析到了\r，但是还没碰到\n
-        // 而这一次解析碰到了\n
-        else if (ch == '\n')  // 如果是\n，判断上一个是不是\r
-        {
-            // m_checked_idx > 0 不可以
-            // 即使0号是'\r',1号是'\n'，前面也没数据，不能解析
-            if (m_checked_idx > 1 && m_readbuf[m_checked_idx - 1] == '\r') {
-                m_readbuf[m_checked_idx - 1] = '\0';  // \r变成字符串分隔符
-                m_readbuf[m_checked_idx++] = '\0';    // \n变成字符串分隔符
-                return LINE_OK;                       // 解析成功
-            }
-            return LINE_BAD;  // 只有\n，解析失败
+    // 用向量指令一次检查16/32个字符，直接跳到下一个\r或\n，没有时说明内容还不完整
+    const char *end = m_readbuf + m_read_idx;
+    const char *hit = char_scan::find_eol(m_readbuf + m_checked_idx, end);
+    m_checked_idx = hit - m_readbuf;
+    if (hit == end) {
+        return LINE_OPEN;
+    }
+
+    // 如果是\r，判断下一个是不是\n
+    if (*hit == '\r') {
+        // m_checked_idx已经是读入的最后一个字符了
+        if (m_checked_idx + 1 == m_read_idx) {
+            return LINE_OPEN;  // 行数据还不完整
+        } else if (m_readbuf[m_checked_idx + 1] == '\n') {
+            m_readbuf[m_checked_idx++] = '\0';  // \r变成字符串分隔符
+            m_readbuf[m_checked_idx++] = '\0';  // \n变成字符串分隔符
+            return LINE_OK;                     // 行解析成功
         }
+        return LINE_BAD;  // 只有\r说明行出错
+    }
+    // 这种情况出现说明是上面行数据不完整，之前可能解析到了\r，但是还没碰到\n
+    // 而这一次解析碰到了\n，判断上一个是不是\r
+    // m_checked_idx > 0 不可以
+    // 即使0号是'\r',1号是'\n'，前面也没数据，不能解析
+    if (m_checked_idx > 1 && m_readbuf[m_checked_idx - 1] == '\r') {
+        m_readbuf[m_checked_idx - 1] = '\0';  // \r变成字符串分隔符
+        m_readbuf[m_checked_idx++] = '\0';    // \n变成字符串分隔符
+        return LINE_OK;                       // 解析成功
     }
-    return LINE_OPEN;  // for循环已经遍历完了，还没有碰到\r和\n时，说明内容还不完整
+    return LINE_BAD;  // 只有\n，解析失败
 }
 
 // 解析HTTP请求  主状态机
@@ -197,21 +275,16 @@ http_conn::HTTP_CODE http_conn::process_read() {
 
     char *text = 0;
 
-    // 解析到了一行完整的数据，或者解析到了请求体且数据完整
-    while ((m_check_state == CHECK_STATE_CONTENT && line_status == LINE_OK) ||
-           ((line_status = parse_line()) == LINE_OK)) {
+    // 解析到了一行完整的数据。请求体不按行划分，由read_body接收，这里只解析到头部结束
+    while ((line_status = parse_line()) == LINE_OK) {
         // 获取一行数据
         // 该函数不过是返回了该行数据的首下标而已
-        // 由于我们在解析一行时已经将后面的\r和\n都处理为'\0'，故可以直接输出。
+        // 由于我们在解析一行时已经将后面的\r和\n都处理为'\0'，故可以直接当作字符串解析。
         text = get_line();
 
         // 解析了一行之后，接下来新的行首下标就从当前下标开始了
         m_start_line = m_checked_idx;
 
-        // std::cout << "got 1 http line: " << text << std::endl;
-        LOG_INFO("%s", text);
-        Log::get_instance()->flush();
-
         // 根据当前状态进行转移
         switch (m_check_state) {
             // 正在分析请求行
@@ -230,28 +303,20 @@ http_conn::HTTP_CODE http_conn::process_read() {
                 if (ret == BAD_REQUEST) {
                     return BAD_REQUEST;
                 } else if (ret == GET_REQUEST) {
-                    // 已经得到了完整头部，分析目标文件属性
-                    return do_request();
-                }
-
-                // 跳出switch，继续下一行解析
-                break;
-            }
-            // 正在分析内容
-            case CHECK_STATE_CONTENT: {
-                ret = parse_content(text);
-                if (ret == GET_REQUEST) {
-                    // 已经成功解析内容，分析目标文件属性
-                    return do_request();
+                    // 已经得到了完整头部，由调用者接收请求体(如果有)并分析目标文件属性
+                    return GET_REQUEST;
                 }
-                line_status = LINE_OPEN;
 
                 // 跳出switch，继续下一行解析
                 break;
             }
-            default: return INTERNAL_ERROR;  // 除开这三种情况，服务器内部错误
+            default: return INTERNAL_ERROR;  // 除开这两种情况，服务器内部错误
         }
     }
+    // 读缓冲区已经到了上限，请求行或头部还不完整，请求过大
+    if (m_read_idx + 1 >= m_max_read) {
+        return BAD_REQUEST;
+    }
     return NO_REQUEST;
 }
 
@@ -260,20 +325,25 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     // 解析出GET字段
     // GET\t/index.html HTTP/1.1
     // strpbrk(s1, s2);  在s1中查找s2第一次出现的位置
-    m_url = strpbrk(text, " \t");  // 第一次出现\t是在GET后面
+    m_cold->url = strpbrk(text, " \t");  // 第一次出现\t是在GET后面
     // 找不到
-    if (!m_url) {
+    if (!m_cold->url) {
         return BAD_REQUEST;
     }
     // 把\t变成字符串分隔符  此时m_url++后，m_url指向/
-    *m_url++ = '\0';
+    *m_cold->url++ = '\0';
     // GET\0/index.html HTTP/1.1
 
     char *method = text;  // 再从头开始获得字符串，GET就被取出来了
     // strcasecmp(s1, s2); 不区分大小写比较s1和s2的字典顺序大小，返回0表示相同
-    // 确实是GET字段
     if (strcasecmp(method, "GET") == 0) {
-        m_method = GET;
+        m_cold->method = GET;
+    } else if (strcasecmp(method, "HEAD") == 0) {
+        m_cold->method = HEAD;
+    } else if (strcasecmp(method, "POST") == 0) {
+        m_cold->method = POST;
+    } else if (strcasecmp(method, "PUT") == 0) {
+        m_cold->method = PUT;
     } else {
         // 否则出错
         return BAD_REQUEST;
@@ -281,18 +351,18 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
 
     // 解析出版本
     // m_version指向'/index.html HTTP/1.1'中的间隔符
-    m_version = strpbrk(m_url, " \t");
+    m_cold->version = strpbrk(m_cold->url, " \t");
     // 此时的请求行：/index.html HTTP/1.1
 
     // 如果找不到间隔符，说明格式错了
-    if (!m_version) {
+    if (!m_cold->version) {
         return BAD_REQUEST;
     }
     // 将间隔符变成字符串分隔符
-    *m_version++ = '\0';
+    *m_cold->version++ = '\0';
     // m_version指向HTTP中的H
 
-    if (strcasecmp(m_version, "HTTP/1.1") != 0) {
+    if (strcasecmp(m_cold->version, "HTTP/1.1") != 0) {
         return BAD_REQUEST;  // 语法错误
     }
 
@@ -300,16 +370,16 @@ http_conn::HTTP_CODE http_conn::parse_request_line(char *text) {
     // 有些网页会出现 http://172.25.29.103/index.html
     // 考虑这种情况
     // strncasecmp(s1, s2, n) 只对比s1和s2的前n个字符，看是否相等
-    if (strncasecmp(m_url, "http://", 7) == 0) {  // 相等，属于这种情况的，就让m_url后移7位，
-        m_url += 7;
+    if (strncasecmp(m_cold->url, "http://", 7) == 0) {  // 相等，属于这种情况的，就让m_url后移7位，
+        m_cold->url += 7;
         // strchr(s1, ch);用于查找s1中第一次出现字符ch的位置
         // 这里让m_url等于第一次出现/的位置，即跳过了http://...这一部分，直接到/index.html这一部分
         // 跳过了IP地址
-        m_url = strchr(m_url, '/');
+        m_cold->url = strchr(m_cold->url, '/');
     }
 
     // 这里必然是/index.html，如果m_url没有找到'/'，或m_url的第一个值不是/，说明语法有误
-    if (!m_url || m_url[0] != '/') {
+    if (!m_cold->url || m_cold->url[0] != '/') {
         return BAD_REQUEST;
     }
 
@@ -326,101 +396,366 @@ http_conn::HTTP_CODE http_conn::parse_headers(char *text) {
     // 遇到空行，表示头部字段解析完毕
     // 因为请求头部跟请求内容中间有个\r\n间隔
     if (text[0] == '\0') {
-        // 如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体，
-        // 状态机转移到CHECK_STATE_CONTENT状态
-        if (m_content_length != 0) {
+        // 如果HTTP请求有消息体，状态机转移到CHECK_STATE_CONTENT状态，由调用者接着接收；
+        // 同时有Transfer-Encoding和Content-Length时以前者为准
+        if (m_cold->chunked) {
+            m_check_state = CHECK_STATE_CONTENT;
+            m_cold->body_state = BODY_CHUNK_SIZE;
+        } else if (m_cold->content_length > 0) {
             m_check_state = CHECK_STATE_CONTENT;
-            return NO_REQUEST;  // 请求不完整
+            m_cold->body_state = BODY_DATA;
+            m_cold->body_left = m_cold->content_length;
         }
-        // 否则说明我们已经得到了一个完整的HTTP请求
-        return GET_REQUEST;
+        // 头部已经完整
+        return route();
+    }
+    // 先找到分隔名字和值的冒号，没有冒号或者名字为空的行不是头部，忽略
+    // parse_line把行尾的\r\n换成了两个'\0'，这一行到m_checked_idx - 2为止
+    char *line_end = m_readbuf + m_checked_idx - 2;
+    char *colon = (char *)char_scan::find_char(text, line_end, ':');
+    if (colon == line_end || colon == text) {
+        return NO_REQUEST;
+    }
+    if (m_cold->header_count == MAX_HEADERS) {
+        return BAD_REQUEST;  // 头部太多
+    }
+    // strspn(s1, s2) 检索字符串 s1 中第一个不在字符串s2中出现的字符下标。
+    char *value = colon + 1;
+    value += strspn(value, " \t");  // 相当于skip掉间隔符
+    char *value_end = line_end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+    }
+
+    // 记入头部索引，只保存偏移和长度；已知字段由完美哈希识别，记下它在索引中的位置
+    int idx = m_cold->header_count++;
+    header_field &f = m_cold->headers[idx];
+    f.name = text - m_readbuf;
+    f.name_len = colon - text;
+    f.value = value - m_readbuf;
+    f.value_len = value_end - value;
+    HEADER h = lookup_header(text, f.name_len);
+    if (h == HDR_UNKNOWN) {
+        return NO_REQUEST;  // 其余字段只记入索引，需要时按名字查找
     }
-    // 处理Connection字段
-    // Connection: keep-alive
-    // strncasecmp(s1, s2, n); 不区分大小写比较s1和s2前n个字符的字典顺序大小，返回0表示相同
-    else if (strncasecmp(text, "Connection:", 11) == 0) {
-        text += 11;  // 现在text指向中间的间隔符
-        // strspn(s1, s2) 检索字符串 s1 中第一个不在字符串s2中出现的字符下标。
-        text += strspn(text, " \t");  // 相当于skip掉间隔符
-        // keep-alive说明保持连接
-        if (strcasecmp(text, "keep-alive") == 0) {
-            m_linger = true;
-        }
-    }
-    // 处理Content-Length头部字段
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) {
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);  // 读取内容长度字段
-    }
-    // 处理Host头部字段
-    else if (strncasecmp(text, "Host:", 5) == 0) {
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;  // 读取host字段
-    }
-    // 除了之前的字段，其余都视为头部解析出错
-    else {
-        // printf("oop! unknow header %s\n", text);
-        LOG_INFO("oop!unknow header: %s", text);
-        Log::get_instance()->flush();
+    if (m_cold->known[h] < 0) {
+        m_cold->known[h] = idx;
+    }
+
+    switch (h) {
+        // 处理Connection字段
+        // Connection: keep-alive
+        case HDR_CONNECTION: {
+            // keep-alive说明保持连接
+            if (f.value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0) {
+                m_linger = true;
+            }
+            break;
+        }
+        // 处理Content-Length头部字段，只能是十进制数字
+        case HDR_CONTENT_LENGTH: {
+            char *digits_end;
+            m_cold->content_length = strtoll(value, &digits_end, 10);  // 读取内容长度字段
+            if (f.value_len == 0 || digits_end != value_end || !isdigit((unsigned char)*value)) {
+                return BAD_REQUEST;
+            }
+            break;
+        }
+        // 只支持chunked编码
+        case HDR_TRANSFER_ENCODING: {
+            if (f.value_len != 7 || strncasecmp(value, "chunked", 7) != 0) {
+                return BAD_REQUEST;
+            }
+            m_cold->chunked = true;
+            break;
+        }
+        default: break;
     }
     return NO_REQUEST;  // 请求不完整
 }
 
-// 解析请求体 我们没有真正解析HTTP请求的消息体，只是判断它是否被完整的读入了
-// 甚至我们都没有去读内容体这几行，为了节省效率
-// 何以见得？看上面主从状态机while循环，先判断是否解析内容体，再判断：解析一行是否正确
-// 故刚解析完头部，状态转为解析内容体后，就没有进入解析一行，就直接跳到这里了
-http_conn::HTTP_CODE http_conn::parse_content(char *text) {
-    // 如果当前处理的下标+内容长度没有比缓冲区当前下标大，说明有内容体已经读入，请求完整
-    // 这里的当前处理的下标是刚处理完请求头部后的下标
-    if ((m_checked_idx + m_content_length) <= m_read_idx) {
-        // 当前text正好是上次m_checked_idx，因此下标直接写入m_content_length就是内容体的最后
-        text[m_content_length] = '\0';
-        return GET_REQUEST;  // 请求完整
+// 路径中是否有..这一段
+static bool has_dot_dot(const char *path, int len) {
+    for (int i = 0; i + 2 <= len; ++i) {
+        if (path[i] == '.' && path[i + 1] == '.' && (i == 0 || path[i - 1] == '/') &&
+            (i + 2 == len || path[i + 2] == '/')) {
+            return true;
+        }
     }
-    return NO_REQUEST;  // 请求不完整
+    return false;
 }
 
-// 分析目标文件属性，并对本地文件创建内存映射
-http_conn::HTTP_CODE http_conn::do_request() {
+// 路径到查询字符串为止；没有匹配的路由时丢弃请求体后回复404。
+// 静态文件按路径在网站根目录下打开，含有..一段的路径可能跳出根目录，回复403
+http_conn::HTTP_CODE http_conn::route() {
+    cold_data *c = m_cold;
+    int len = strcspn(c->url, "?");
+    if (!m_router.match(c->method, c->url, len, c->handler, c->params, c->param_count)) {
+        c->rejected = NO_RESOURCE;
+        return GET_REQUEST;
+    }
+    if (c->handler == NULL && has_dot_dot(c->url, len)) {
+        c->rejected = FORBIDDEN_REQUEST;
+        return GET_REQUEST;
+    }
+    for (int i = 0; i < c->param_count; ++i) {
+        c->params[i].value += c->url - m_readbuf;
+    }
+    return GET_REQUEST;
+}
+
+bool http_conn::get_param(const char *name, std::string_view &value) const {
+    for (int i = 0; i < m_cold->param_count; ++i) {
+        const route_param &p = m_cold->params[i];
+        if (strcmp(p.name, name) == 0) {
+            value = std::string_view(m_readbuf + p.value, p.value_len);
+            return true;
+        }
+    }
+    return false;
+}
+
+// chunked编码中块长度行和尾部每行的最大长度
+static const int MAX_CHUNK_LINE = 1024;
+
+// 接收请求体：把读缓冲区中已经收到的部分解码，按块交给处理者，没有处理者(GET/HEAD)时直接丢弃
+// 解码后的数据就地挪到头部之后(m_checked_idx处)，覆盖掉chunked编码的块长度行等；交出去的部分
+// 从读缓冲区中删除，后面的数据跟着前移，读缓冲区中只留下头部、不满一块的请求体和还没解码的数据。
+// 请求体结束的位置就是m_checked_idx，之后是流水线上的下一个请求。
+// 收完返回GET_REQUEST，还要继续接收返回NO_REQUEST，编码有误返回BAD_REQUEST，处理者中止返回INTERNAL_ERROR
+http_conn::HTTP_CODE http_conn::read_body() {
+    cold_data *c = m_cold;
+    char *body = m_readbuf + m_checked_idx;
+    char *out = body + c->body_len;  // 解码后的数据写到这里
+    char *p = out;                   // 还没解码的数据从这里开始
+    char *end = m_readbuf + m_read_idx;
+    bool done = false;
+    while (!done) {
+        if (c->body_state == BODY_DATA) {
+            int n = end - p < c->body_left ? end - p : c->body_left;
+            if (out != p) {
+                memmove(out, p, n);
+            }
+            out += n;
+            p += n;
+            c->body_left -= n;
+            c->body_received += n;
+            if (c->body_left > 0) {
+                break;  // 这一段还没收完
+            }
+            if (c->chunked) {
+                c->body_state = BODY_CHUNK_END;
+            } else {
+                done = true;
+            }
+            continue;
+        }
+        if (c->body_state == BODY_CHUNK_END) {
+            // 块数据后面紧跟\r\n
+            if (end - p < 2) {
+                break;
+            }
+            if (p[0] != '\r' || p[1] != '\n') {
+                return BAD_REQUEST;
+            }
+            p += 2;
+            c->body_state = BODY_CHUNK_SIZE;
+            continue;
+        }
+        // 块长度行和尾部都以\r\n结尾
+        char *lf = (char *)char_scan::find_char(p, end, '\n');
+        if (lf == end) {
+            if (end - p > MAX_CHUNK_LINE) {
+                return BAD_REQUEST;
+            }
+            break;
+        }
+        if (lf - p > MAX_CHUNK_LINE || lf == p || lf[-1] != '\r') {
+            return BAD_REQUEST;
+        }
+        char *line_end = lf - 1;
+        if (c->body_state == BODY_CHUNK_SIZE) {
+            // 十六进制的块长度，后面可能跟着以;开头的扩展，忽略
+            long long size = 0;
+            char *q = p;
+            for (; q < line_end && isxdigit((unsigned char)*q); ++q) {
+                if (size >> 59) {
+                    return BAD_REQUEST;  // 块过大
+                }
+                size = size * 16 + (isdigit((unsigned char)*q) ? *q - '0' : (*q | 0x20) - 'a' + 10);
+            }
+            if (q == p || (q < line_end && *q != ';' && *q != ' ' && *q != '\t')) {
+                return BAD_REQUEST;
+            }
+            if (size == 0) {
+                c->body_state = BODY_TRAILER;  // 最后一块
+            } else {
+                c->body_state = BODY_DATA;
+                c->body_left = size;
+            }
+        } else if (line_end == p) {
+            done = true;  // 尾部的字段忽略，空行表示请求体结束
+        }
+        p = lf + 1;
+    }
+
+    // 还没解码的数据接到解码后的数据后面
+    int raw = end - p;
+    if (out != p && raw > 0) {
+        memmove(out, p, raw);
+    }
+    m_read_idx = out - m_readbuf + raw;
+    c->body_len = out - body;
+
+    // 攒够一块就交出一块；收完时交出剩下的，读缓冲区到了上限、攒不够一块时也只能先交出去
+    int off = 0;
+    while (c->body_len - off >= BODY_CHUNK) {
+        if (c->handler != NULL && !c->handler->data(*this, body + off, BODY_CHUNK)) {
+            return INTERNAL_ERROR;
+        }
+        off += BODY_CHUNK;
+    }
+    if (c->body_len > off && (done || m_read_idx + 1 >= m_max_read)) {
+        if (c->handler != NULL && !c->handler->data(*this, body + off, c->body_len - off)) {
+            return INTERNAL_ERROR;
+        }
+        off = c->body_len;
+    }
+    if (off > 0) {
+        memmove(body, body + off, m_read_idx - m_checked_idx - off);
+        m_read_idx -= off;
+        c->body_len -= off;
+    }
+    if (done) {
+        return GET_REQUEST;
+    }
+    // 交出数据后读缓冲区仍然是满的(头部太大，或者chunked编码的一行太长)，无法再接收
+    if (m_read_idx + 1 >= m_max_read) {
+        return BAD_REQUEST;
+    }
+    return NO_REQUEST;
+}
+
+bool http_conn::get_header(HEADER h, std::string_view &value) const {
+    int idx = m_cold->known[h];
+    if (idx < 0) {
+        return false;
+    }
+    const header_field &f = m_cold->headers[idx];
+    value = std::string_view(m_readbuf + f.value, f.value_len);
+    return true;
+}
+
+bool http_conn::get_header(std::string_view name, std::string_view &value) const {
+    HEADER h = lookup_header(name.data(), name.size());
+    if (h != HDR_UNKNOWN) {
+        return get_header(h, value);
+    }
+    for (int i = 0; i < m_cold->header_count; ++i) {
+        const header_field &f = m_cold->headers[i];
+        if (f.name_len == name.size() &&
+            strncasecmp(m_readbuf + f.name, name.data(), name.size()) == 0) {
+            value = std::string_view(m_readbuf + f.value, f.value_len);
+            return true;
+        }
+    }
+    return false;
+}
+
+void http_conn::get_header_at(int i, std::string_view &name, std::string_view &value) const {
+    const header_field &f = m_cold->headers[i];
+    name = std::string_view(m_readbuf + f.name, f.name_len);
+    value = std::string_view(m_readbuf + f.value, f.value_len);
+}
+
+void http_conn::build_real_file() {
     // 把根目录拷贝到m_real_file中
-    strcpy(m_real_file, doc_root);
+    strcpy(m_cold->real_file, doc_root);
 
-    // 将m_url拼接到dock_root后面
-    int len = strlen(doc_root);
+    // 将m_url中查询字符串之前的路径(与路由匹配的部分)拼接到dock_root后面
+    int len = sizeof(doc_root) - 1;
+    int path_len = strcspn(m_cold->url, "?");
     // FILENAME_LEN - len - 1限制了url长度不能超过文件名最大长度
-    strncpy(m_real_file + len, m_url, FILENAME_LEN - len - 1);
-    // 通过stat函数将文件属性获取到m_file_stat中
-    if (stat(m_real_file, &m_file_stat) == -1) {
-        // 获取失败
-        return NO_RESOURCE;
+    if (path_len > FILENAME_LEN - len - 1) {
+        path_len = FILENAME_LEN - len - 1;
     }
+    memcpy(m_cold->real_file + len, m_cold->url, path_len);
+    m_cold->real_file[len + path_len] = '\0';
+}
 
-    // 判断访问权限  是否有其他人读取权限（read by others）
-    if (!(m_file_stat.st_mode & S_IROTH)) {
-        return FORBIDDEN_REQUEST;  // 禁止访问
+// 处理完整的请求头部：路由选出了处理者的，边接收边把请求体交给它，收完后由它生成响应；
+// 静态文件、没有路由和被处理者拒绝的丢弃请求体，后两者回复错误，
+// 静态文件再分析目标文件属性，从文件缓存中取得目标文件。
+// 请求体还没收完时返回NO_REQUEST，收到更多数据后再次调用
+http_conn::HTTP_CODE http_conn::do_request() {
+    cold_data *c = m_cold;
+    if (c->handler != NULL && !c->begun) {
+        c->begun = true;
+        if (c->handler->begin(*this)) {
+            expect_continue();
+        } else {
+            c->handler = NULL;
+            c->rejected = FORBIDDEN_REQUEST;
+        }
     }
-
-    // 判断是否是目录
-    if (S_ISDIR(m_file_stat.st_mode)) {
-        return BAD_REQUEST;  // 是目录，不给返回
+    if (m_check_state == CHECK_STATE_CONTENT) {
+        HTTP_CODE ret = read_body();
+        if (ret != GET_REQUEST) {
+            if (ret != NO_REQUEST) {
+                m_linger = false;
+            }
+            return ret;
+        }
+    }
+    if (c->rejected != NO_REQUEST) {
+        return c->rejected;
+    }
+    if (c->handler != NULL) {
+        int mark = m_write_idx;
+        if (!c->handler->end(*this) || m_write_idx == mark) {
+            m_write_idx = mark;  // 丢掉写了一半的响应
+            return INTERNAL_ERROR;
+        }
+        return DYNAMIC_REQUEST;
     }
 
-    // 以只读方式打开文件
-    int fd = open(m_real_file, O_RDONLY);
-    // 创建内存映射
-    m_file_address = (char *)mmap(0, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    build_real_file();
+    // 从文件缓存中取得打开并映射好的文件，缓存未命中时才stat、open和mmap
+    int err = 0;
+    m_cold->file = file_cache::acquire(m_cold->real_file, err);
+    if (m_cold->file == NULL) {
+        switch (err) {
+            case ENOENT:
+            case ENOTDIR:
+            case ENAMETOOLONG: return NO_RESOURCE;
+            case EACCES: return FORBIDDEN_REQUEST;  // 禁止访问
+            case EISDIR: return BAD_REQUEST;        // 是目录，不给返回
+            default: return INTERNAL_ERROR;
+        }
+    }
+    m_file_address = m_cold->file->addr;
     return FILE_REQUEST;
 }
 
-// 对内存映射区执行munmap操作
-void http_conn::unmap() {
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+// 客户端带有Expect: 100-continue时先回复100 Continue，它收到后才发送请求体；
+// 已经收到了请求体，或者前面还有没发出的响应时不回复，客户端等一会儿也会发送
+void http_conn::expect_continue() {
+    std::string_view v;
+    if (m_check_state != CHECK_STATE_CONTENT || m_write_idx > 0 || m_read_idx > m_checked_idx ||
+        !get_header(HDR_EXPECT, v) || v.size() != 12 ||
+        strncasecmp(v.data(), "100-continue", 12) != 0) {
+        return;
+    }
+    static const char response[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    send(m_sockfd, response, sizeof(response) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+// 归还目标文件的引用，映射由文件缓存在最后一个引用释放时解除
+void http_conn::release_file() {
+    if (m_cold->file != NULL) {
+        file_cache::release(m_cold->file);
+        m_cold->file = NULL;
+        m_file_address = NULL;
     }
 }
 
@@ -429,91 +764,142 @@ bool http_conn::write() {
     int len = 0;
     if (bytes_to_send == 0) {
         // 将要发送的字节为0，这一次响应结束。
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_et);  // 监听输入事件
+        m_reactor->rearm(this, EPOLLIN);  // 监听输入事件
         init();
         return true;
     }
 
     while (1) {
-        // 聚集写
-        // 先从写缓冲区中写入sockfd，再从文件中写入sockfd
-        // writev函数用于将多个分散的缓存区中的内容聚集在一起写入一个fd，返回值是此次写入的数据大小
-        len = writev(m_sockfd, m_iv, m_iv_count);
+        if (!m_sendfile) {
+            // 聚集写
+            // 先从写缓冲区中写入sockfd，再从文件中写入sockfd
+            // writev函数用于将多个分散的缓存区中的内容聚集在一起写入一个fd，返回值是此次写入的数据大小
+            len = writev(m_sockfd, m_iv, m_iv_count);
+        } else if (m_iv[0].iov_len > 0) {
+            // 大文件：响应头带MSG_MORE先进入发送队列，与随后sendfile的文件内容合并成满长度的报文
+            len = send(m_sockfd, m_iv[0].iov_base, m_iv[0].iov_len, MSG_MORE);
+        } else {
+            // 文件内容由内核直接从页缓存送入socket，不经过用户态，也不需要映射文件
+            off_t offset = bytes_have_send - m_write_idx;
+            len = sendfile(m_sockfd, m_cold->file->fd, &offset, bytes_to_send);
+            if (len == 0) {
+                // 文件在发送期间被截短了，无法发完声明的长度
+                release_file();
+                return false;
+            }
+        }
         // -1表示写入出错
         if (len == -1) {
             // 如果TCP写缓冲没有空间，即sockfd写入空间不足，则等待下一轮EPOLLOUT事件，
             // 虽然在此期间，服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性。
             if (errno == EAGAIN) {
                 // 继续监听输出事件
-                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_et);
+                m_reactor->rearm(this, EPOLLOUT);
                 return true;
             }
-            // 不是空间不足造成的，那么说明是调用出错了，取消内存映射
-            unmap();
+            // 不是空间不足造成的，那么说明是调用出错了，归还目标文件
+            release_file();
             return false;
         }
 
-        // 要发送的数据长度减去这次发送的
-        bytes_to_send -= len;
+        advance_write(len);
 
-        // 已经发送的数据长度加上这次发送的
-        bytes_have_send += len;
-
-        // 如果0号写入区，即写缓冲区已经读满，开始从1号读入
-        if (bytes_have_send >= m_iv[0].iov_len) {
-            m_iv[0].iov_len = 0;  // len置空
-            // 文件起始位置就是已经发送的所有字节数减去写缓冲区发送的所有字节数剩余部分+m_file_address
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
-        } else {
-            // 0号还没读满，修改下一次读数据的位置
-            // 0号文件起始地址增加
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            // 长度相应减少
-            m_iv[0].iov_len = m_iv[0].iov_len - bytes_have_send;
-        }
         // 没有数据要发送了
         if (bytes_to_send <= 0) {
-            // 解除映射
-            unmap();
-            // 检测读入
-            modfd(m_epollfd, m_sockfd, EPOLLIN, m_et);
-            // 若保持连接，就再初始化
-            if (m_linger) {
-                init();
-                return true;
-            } else {
+            if (!finish_write()) {
                 return false;
             }
+            // 检测读入；流水线上还有解析完的请求时由reactor接着处理，不能同时等待EPOLLIN
+            if (!has_pending()) {
+                m_reactor->rearm(this, EPOLLIN);
+            }
+            return true;
         }
     }
 }
 
-// 往写缓冲中写入待发送的数据 类似printf函数
-bool http_conn::add_response(const char *format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE)  // 写缓冲已经满了
-    {
-        return false;
+// 已经发送了len字节，调整下一次要发送的数据块
+void http_conn::advance_write(int len) {
+    // 要发送的数据长度减去这次发送的
+    bytes_to_send -= len;
+
+    // 已经发送的数据长度加上这次发送的
+    bytes_have_send += len;
+
+    // 如果0号写入区，即写缓冲区已经发送完毕，开始发送1号
+    if (bytes_have_send >= m_write_idx) {
+        m_iv[0].iov_len = 0;  // len置空
+        if (!m_sendfile) {
+            // 文件起始位置就是已经发送的所有字节数减去写缓冲区发送的所有字节数剩余部分+m_file_address
+            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
+            m_iv[1].iov_len = bytes_to_send;
+        }
+    } else {
+        // 0号还没发送完，修改下一次发送数据的位置。0号可能是写缓冲区，也可能是文件缓存中的完整响应
+        int sent = m_iv[0].iov_len - (m_write_idx - bytes_have_send);
+        m_iv[0].iov_base = (char *)m_iv[0].iov_base + sent;
+        // 长度相应减少
+        m_iv[0].iov_len -= sent;
     }
+}
 
-    va_list arg_list;            // va_list生成一个指针，用于指向可选参数
-    va_start(arg_list, format);  // 将指针指向我们的可选参数
+bool http_conn::get_file_body(int &fd, off_t &offset, int &len) const {
+    if (!m_sendfile) {
+        return false;
+    }
+    fd = m_cold->file->fd;
+    // 响应头剩余的部分还在m_iv[0]中
+    len = bytes_to_send - m_iv[0].iov_len;
+    offset = m_cold->file->st.st_size - len;
+    return true;
+}
 
-    // 写缓冲区剩余可写入容量
-    int remain_size = WRITE_BUFFER_SIZE - 1 - m_write_idx;
-    // vsnprintf()将格式化数据从可变参数列表写入大小
-    // vsnprintf(index, size, format, ...)，后面的format和...可以理解为就是一个printf
-    int len = vsnprintf(m_write_buf + m_write_idx, remain_size, format, arg_list);
-    if (len >= remain_size)  // 超出写缓冲范围
-    {
+// 响应发送完毕，归还目标文件，若保持连接就再初始化
+bool http_conn::finish_write() {
+    release_file();
+    if (!m_keep_alive) {
         return false;
     }
-    m_write_idx += len;
+    if (m_read_idx == 0) {
+        init();
+        return true;
+    }
+    // 读缓冲区中还有流水线上的下一个请求(或者它的一部分)，只重置发送状态，保留读缓冲区
+    m_sendfile = false;
+    m_write_idx = 0;
+    bytes_have_send = 0;
+    bytes_to_send = 0;
+    if (m_write_buf != NULL) {
+        buffer_pool::release(m_write_buf, m_write_cap);
+        m_write_buf = NULL;
+        m_write_cap = 0;
+    }
+    return true;
+}
 
-    va_end(arg_list);  // 结束可变参数
+// 往写缓冲中写入待发送的数据 类似printf函数
+bool http_conn::add_response(const char *format, ...) {
+    while (true) {
+        // 写缓冲区剩余可写入容量
+        int remain_size = usable(m_write_cap, m_max_write) - 1 - m_write_idx;
+        if (remain_size > 0) {
+            va_list arg_list;            // va_list生成一个指针，用于指向可选参数
+            va_start(arg_list, format);  // 将指针指向我们的可选参数
+            // vsnprintf()将格式化数据从可变参数列表写入大小
+            // vsnprintf(index, size, format, ...)，后面的format和...可以理解为就是一个printf
+            int len = vsnprintf(m_write_buf + m_write_idx, remain_size, format, arg_list);
+            va_end(arg_list);  // 结束可变参数
+            if (len < remain_size) {
+                m_write_idx += len;
+                break;
+            }
+        }
+        // 放不下，换更大的一级重新格式化；已达上限说明响应头过大
+        if (!grow_buffer(m_write_buf, m_write_cap, m_write_idx, m_max_write)) {
+            return false;
+        }
+    }
 
-    LOG_INFO("request:%s", m_write_buf);
-    Log::get_instance()->flush();
     return true;
 }
 
@@ -546,53 +932,121 @@ bool http_conn::add_content(const char *content) {
     return add_response("%s", content);
 }
 
+bool http_conn::add_body(const char *content) {
+    return m_cold->method == HEAD || add_content(content);
+}
+
+bool http_conn::reply(int status, const char *title, const char *content_type, const char *body,
+                      int len) {
+    int mark = m_write_idx;
+    if (!add_status_line(status, title) || !add_content_length(len) ||
+        !add_response("Content-Type:%s\r\n", content_type) || !add_linger() ||
+        !add_blank_line()) {
+        m_write_idx = mark;
+        return false;
+    }
+    if (m_cold->method == HEAD || len == 0) {
+        return true;
+    }
+    // 响应体可能不是字符串，直接拷贝
+    if (!reserve_write(len)) {
+        m_write_idx = mark;
+        return false;
+    }
+    memcpy(m_write_buf + m_write_idx, body, len);
+    m_write_idx += len;
+    return true;
+}
+
 bool http_conn::add_content_type() {
     return add_response("Content-Type:%s\r\n", "text/html");
 }
 
 // 根据服务器处理HTTP请求的结果，决定返回给客户端的内容
+// 写缓冲区中已经有流水线上前面请求的响应时，新的响应追加在后面，整批一起发送
 bool http_conn::process_write(HTTP_CODE read_ret) {
+    // 请求有误时不知道它在哪里结束，后面的数据无法再解析，回复后关闭连接
+    if (read_ret == BAD_REQUEST) {
+        m_linger = false;
+    }
+    m_keep_alive = m_linger;
     switch (read_ret) {
         case INTERNAL_ERROR:  // 服务器内部错误
         {
             add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if (!add_content(error_500_form)) {
+            add_headers(sizeof(error_500_form) - 1);
+            if (!add_body(error_500_form)) {
                 return false;
             }
             break;
         }
         case BAD_REQUEST: {  // 客户请求语法错误
             add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_form));
-            if (!add_content(error_400_form)) {
+            add_headers(sizeof(error_400_form) - 1);
+            if (!add_body(error_400_form)) {
                 return false;
             }
             break;
         }
         case NO_RESOURCE: {  // 服务器没有资源
             add_status_line(404, error_404_title);
-            add_headers(strlen(error_404_form));
-            if (!add_content(error_404_form)) {
+            add_headers(sizeof(error_404_form) - 1);
+            if (!add_body(error_404_form)) {
                 return false;
             }
             break;
         }
         case FORBIDDEN_REQUEST: {  // 客户对资源没有足够的访问权限
             add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            if (!add_content(error_403_form)) {
+            add_headers(sizeof(error_403_form) - 1);
+            if (!add_body(error_403_form)) {
                 return false;
             }
             break;
         }
         case FILE_REQUEST: {  // 获取文件成功
+            file_entry *file = m_cold->file;
+            bool head = m_cold->method == HEAD;
+            if (file->response[0] != NULL) {
+                int i = m_linger ? 1 : 0;
+                // HEAD请求只发送完整响应中响应头的部分
+                int len = file->response_len[i] - (head ? file->st.st_size : 0);
+                if (m_write_idx == 0) {
+                    // 小文件：文件缓存中有序列化好的完整响应，直接发送，不占用写缓冲区
+                    m_iv[0].iov_base = file->response[i];
+                    m_iv[0].iov_len = len;
+                    m_iv_count = 1;
+                    // 整个响应都当作"响应头"，发送进度的计算与写缓冲区相同
+                    m_write_idx = bytes_to_send = len;
+                    return true;
+                }
+                // 前面还有别的响应：放得下就拷到写缓冲区中，否则作为这一批的最后一块直接发送
+                if (reserve_write(len)) {
+                    memcpy(m_write_buf + m_write_idx, file->response[i], len);
+                    m_write_idx += len;
+                    break;
+                }
+                m_file_address = file->response[i];
+                m_iv[0].iov_base = m_write_buf;
+                m_iv[0].iov_len = m_write_idx;
+                m_iv[1].iov_base = m_file_address;
+                m_iv[1].iov_len = len;
+                m_iv_count = 2;
+                bytes_to_send = m_write_idx + len;
+                return true;
+            }
             add_status_line(200, ok_200_title);
             // 如果文件大小不为空
-            if (m_file_stat.st_size != 0) {
-                add_headers(m_file_stat.st_size);
+            if (m_cold->file->st.st_size != 0) {
+                // Content-Length和Content-Type两行在打开文件时已经生成好
+                add_content(m_cold->file->headers);
+                add_linger();
+                add_blank_line();
 
                 // 添加首行后不用添加内容，内容由我们写入
+                if (head) {
+                    break;
+                }
 
                 // 分别填写两个缓冲区的起始位置和长度
 
@@ -600,24 +1054,32 @@ bool http_conn::process_write(HTTP_CODE read_ret) {
                 m_iv[0].iov_base = m_write_buf;
                 // 由于之前向写缓冲写入了状态行和首部，因此当前的写缓冲区索引就是长度
                 m_iv[0].iov_len = m_write_idx;
-                // 1号存放客户请求的目标文件被mmap到内存中的起始位置和长度
-                m_iv[1].iov_base = m_file_address;
-                m_iv[1].iov_len = m_file_stat.st_size;
-
-                // 缓冲区个数为2
-                m_iv_count = 2;
+                if (m_file_address != NULL) {
+                    // 1号存放客户请求的目标文件被mmap到内存中的起始位置和长度
+                    m_iv[1].iov_base = m_file_address;
+                    m_iv[1].iov_len = m_cold->file->st.st_size;
+
+                    // 缓冲区个数为2
+                    m_iv_count = 2;
+                } else {
+                    // 大文件没有映射，响应体由sendfile/splice直接从文件发送
+                    m_sendfile = true;
+                    m_iv_count = 1;
+                }
 
                 // 要发送的字节数=响应头部大小+文件大小
-                bytes_to_send = m_write_idx + m_file_stat.st_size;
+                bytes_to_send = m_write_idx + m_cold->file->st.st_size;
                 return true;
             } else {
                 // 若为空，就生成一个空html
                 const char *ok_string = "<html><body></body></html>";
                 add_headers(strlen(ok_string));
-                if (!add_content(ok_string))
+                if (!add_body(ok_string))
                     return false;
             }
+            break;
         }
+        case DYNAMIC_REQUEST: break;  // 处理者已经写好了响应
         default: return false;
     }
 
@@ -635,19 +1097,133 @@ bool http_conn::process_write(HTTP_CODE read_ret) {
 // 由线程池中的工作线程调用，处理http请求的入口函数
 // 每个工作线程负责解析请求并生成响应
 void http_conn::process() {
-    // 解析http请求
-    HTTP_CODE read_ret = process_read();
+    // 解析http请求，reactor线程已经解析过的直接使用它的结果；正在接收请求体的接着接收
+    HTTP_CODE read_ret = m_cold->parsed;
+    if (read_ret != NO_REQUEST) {
+        m_cold->parsed = NO_REQUEST;
+    } else if (m_check_state == CHECK_STATE_CONTENT) {
+        read_ret = GET_REQUEST;
+    } else {
+        read_ret = process_read();
+    }
     if (read_ret == NO_REQUEST) {
         // 修改事件为读事件
-        modfd(m_epollfd, m_sockfd, EPOLLIN, m_et);
+        m_reactor->rearm(this, EPOLLIN);
         return;
     }
+    // 生成http响应，读缓冲区中流水线上已经完整的后续请求也依次生成响应，追加到同一批中
+    do {
+        if (read_ret == GET_REQUEST) {
+            read_ret = do_request();
+            if (read_ret == NO_REQUEST) {
+                // 请求体还没收完，继续接收；带请求体的请求总是一批中的第一个，写缓冲区是空的
+                m_reactor->rearm(this, EPOLLIN);
+                return;
+            }
+        }
+        bool write_ret = process_write(read_ret);
+        if (!write_ret) {
+            close_conn();
+            return;
+        }
+    } while (pipeline_next(read_ret));
+    // 修改事件为写事件
+    m_reactor->rearm(this, EPOLLOUT);
+}
+
+// 在reactor线程中处理请求的快速路径
+// 响应缓存命中时只需查一次哈希表、引用序列化好的响应，比交给线程池(入队、唤醒、再通知reactor)快得多；
+// 未命中时要stat、open、读文件，可能阻塞，仍交给线程池
+bool http_conn::process_inline() {
+    // 接收请求体时要调用处理者，可能阻塞，交给线程池
+    if (m_check_state == CHECK_STATE_CONTENT) {
+        return false;
+    }
+    // 上一批留下的流水线请求已经解析过了
+    HTTP_CODE ret = m_cold->parsed;
+    if (ret == NO_REQUEST) {
+        ret = process_read();
+    } else {
+        m_cold->parsed = NO_REQUEST;
+    }
+    if (ret == NO_REQUEST) {
+        return true;
+    }
+    if (ret != GET_REQUEST || !cacheable() || !lookup_cached()) {
+        m_cold->parsed = ret;
+        return false;
+    }
+    // 完整响应不占用写缓冲区，生成响应不会失败
+    process_write(FILE_REQUEST);
+    // 流水线上的后续请求：命中的和请求有误的接着追加到这一批，遇到未命中的先发送这一批，
+    // 发完后再由reactor把它交给线程池
+    while (pipeline_next(ret)) {
+        if (ret == GET_REQUEST) {
+            if (!cacheable() || !lookup_cached()) {
+                m_cold->parsed = ret;
+                break;
+            }
+            ret = FILE_REQUEST;
+        }
+        // 追加之前保证了写缓冲区中留有余地，不会失败
+        process_write(ret);
+    }
+    return true;
+}
 
-    // 生成http响应
-    bool write_ret = process_write(read_ret);
-    if (!write_ret) {
-        close_conn();
+// 路由到静态文件、没有请求体的GET/HEAD请求才可能直接用文件缓存中的完整响应
+bool http_conn::cacheable() const {
+    return m_cold->handler == NULL && m_cold->rejected == NO_REQUEST &&
+           (m_cold->method == GET || m_cold->method == HEAD) &&
+           m_check_state != CHECK_STATE_CONTENT;
+}
+
+bool http_conn::lookup_cached() {
+    build_real_file();
+    m_cold->file = file_cache::lookup(m_cold->real_file);
+    if (m_cold->file == NULL) {
+        return false;
     }
-    // 修改事件为写事件
-    modfd(m_epollfd, m_sockfd, EPOLLOUT, m_et);
+    m_file_address = m_cold->file->addr;
+    return true;
+}
+
+// 流水线上的请求追加到同一批时写缓冲区中至少要留出的字节数，足够放下错误页面或者大文件的响应头
+static const int PIPELINE_HEADROOM = 1024;
+
+// 只有当前的响应全在写缓冲区中(没有另外发送的文件内容)时才能接着追加；
+// 下一个请求完整但这一批放不下时，解析结果留在m_cold->parsed中，发送完后由reactor接着处理
+bool http_conn::pipeline_next(HTTP_CODE &ret) {
+    // 回复后就关闭连接的，后面的数据不再处理
+    if (!m_linger) {
+        return false;
+    }
+    next_request();
+    if (m_read_idx == 0) {
+        return false;
+    }
+    ret = process_read();
+    if (ret == NO_REQUEST) {
+        return false;  // 下一个请求还不完整，这一批发送完后再接着接收
+    }
+    // 带请求体的请求要边接收边处理，放到下一批的开头
+    if (m_iv_count == 1 && !m_sendfile && m_check_state != CHECK_STATE_CONTENT) {
+        if (m_iv[0].iov_base != m_write_buf) {
+            // 文件缓存中的完整响应，拷进写缓冲区，后面的响应才能接在它后面
+            int len = m_write_idx;
+            m_write_idx = 0;
+            if (len + PIPELINE_HEADROOM <= m_max_write && reserve_write(len)) {
+                memcpy(m_write_buf, m_iv[0].iov_base, len);
+                m_iv[0].iov_base = m_write_buf;
+            }
+            m_write_idx = len;
+        }
+        if (m_iv[0].iov_base == m_write_buf && m_write_idx + PIPELINE_HEADROOM <= m_max_write) {
+            // 响应已经拷进写缓冲区，不再需要目标文件了
+            release_file();
+            return true;
+        }
+    }
+    m_cold->parsed = ret;
+    return false;
 }
@@ -8,45 +8,41 @@
 #include <stdarg.h>
 #include <sys/epoll.h>
 #include <sys/mman.h>
+#include <sys/sendfile.h>
 #include <sys/stat.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+#include <atomic>
 #include <cstdio>
 #include <cstring>
 #include <iostream>
+#include <string_view>
 
+#include "body_handler.h"
+#include "file_cache.h"
+#include "http_header.h"
 #include "locker.h"
 #include "log.h"
+#include "router.h"
 class util_timer;  // 定时器类声明
-class http_conn {
+class reactor;     // 事件循环类声明
+// 连接对象分成热、冷两部分：
+// 热数据是每个读写事件和每次收发都要访问的字段，集中放在对象开头的两个缓存行里，对象本身按缓存行对齐，
+// slab中相邻的连接紧挨着存放；冷数据是每个请求只在解析和查找文件时才用到的字段，
+// 由slab在另一块内存中分配，热数据中只保存一个指针。读写缓冲区从缓冲池中按需取用
+class alignas(64) http_conn {
 public:
-    static int m_epollfd;     // 所有socket上的事件都被注册到同一个epoll中
-    static int m_user_count;  // 静态成员变量，统计用户数量
-    static const int READ_BUFFER_SIZE = 2048;   // 读缓冲区大小
-    static const int WRITE_BUFFER_SIZE = 2048;  // 写缓冲区大小
-    static const int FILENAME_LEN = 200;        // 文件名的最大长度
-
-    bool m_et;            // 是否开启ET模式
-    int m_sockfd;         // 该http连接的socket
-    util_timer *m_timer;  // 定时器
+    static std::atomic<int> m_user_count;  // 静态成员变量，统计所有reactor上的用户数量
+    // 读写缓冲区从缓冲池中按需取用，放不下时换成更大的一级，最大不超过以下限制，启动时由参数设置
+    static int m_max_read;                // 一个请求最多占用的读缓冲区字节数
+    static int m_max_write;               // 响应头(及错误页面)最多占用的写缓冲区字节数
+    static const int FILENAME_LEN = 200;  // 文件名的最大长度
+    static const int MAX_HEADERS = 32;    // 一个请求最多的头部个数，超过时按请求有误处理
+    static const int BODY_CHUNK = 8192;   // 请求体交给处理者时每块的字节数
+    static router m_router;               // 请求的路由表，启动时注册，之后只读
 
-    // 网站根目录
-    const char *doc_root = "/home/echo/projects/cpp/WebServer/resources";
-
-    // 定义HTTP响应的一些状态信息
-    const char *ok_200_title = "OK";
-    const char *error_400_title = "Bad Request";
-    const char *error_400_form =
-        "Your request has bad syntax or is inherently impossible to satisfy.\n";
-    const char *error_403_title = "Forbidden";
-    const char *error_403_form = "You do not have permission to get file from this server.\n";
-    const char *error_404_title = "Not Found";
-    const char *error_404_form = "The requested file was not found on this server.\n";
-    const char *error_500_title = "Internal Error";
-    const char *error_500_form = "There was an unusual problem serving the requested file.\n";
-
-    // HTTP请求方法，这里只支持GET
+    // HTTP请求方法，这里支持GET、HEAD、POST和PUT
     enum METHOD { GET = 0, POST, HEAD, PUT, DELETE, TRACE, OPTIONS, CONNECT };
 
     /*
@@ -71,6 +67,7 @@ public:
         FILE_REQUEST        :   文件请求,获取文件成功
         INTERNAL_ERROR      :   表示服务器内部错误
         CLOSED_CONNECTION   :   表示客户端已经关闭连接了
+        DYNAMIC_REQUEST     :   处理者已经在写缓冲区中生成了响应
     */
     enum HTTP_CODE {
         NO_REQUEST,
@@ -80,43 +77,150 @@ public:
         FORBIDDEN_REQUEST,
         FILE_REQUEST,
         INTERNAL_ERROR,
-        CLOSED_CONNECTION
+        CLOSED_CONNECTION,
+        DYNAMIC_REQUEST
+    };
+
+    // 接收请求体时的状态：按Content-Length接收，或者chunked编码的块长度行、块数据、块后的\r\n和尾部
+    enum BODY_STATE { BODY_DATA = 0, BODY_CHUNK_SIZE, BODY_CHUNK_END, BODY_TRAILER };
+
+    // 冷数据：每个请求只在解析请求和查找文件时用到
+    struct cold_data {
+        sockaddr_in address;       // 通信的地址信息
+        char *url;                 // 请求目标文件的文件名
+        char *version;             // 请求目标文件的http协议版本，我们仅支持HTTP1.1
+        METHOD method;             // 请求方法
+        long long content_length;  // 内容长度
+        // 已经解析完、还没有生成响应的请求的解析结果，没有时为NO_REQUEST：
+        // reactor线程交给线程池的请求，或者流水线上这一批响应放不下、留到下一批的请求
+        HTTP_CODE parsed;
+        int header_count;         // 已解析的头部个数
+        int8_t known[HDR_COUNT];  // 已知字段第一次出现时在headers中的下标，没有时为-1
+        bool chunked;             // 请求体是否为chunked编码
+        BODY_STATE body_state;    // 接收请求体的状态
+        // 解码后还没交给处理者的请求体字节数，它们紧接在头部之后，即m_checked_idx处
+        int body_len;
+        long long body_left;      // 当前这一段(整个请求体或者一块)还没收到的字节数
+        long long body_received;  // 已经收到的请求体字节数(解码后)
+        body_handler *handler;    // 路由选出的处理者，静态文件为空，请求体直接丢弃
+        bool begun;               // 是否已经调用了处理者的begin
+        // 没有匹配的路由或者处理者拒绝时要回复的错误，请求体照常接收后丢弃，没有时为NO_REQUEST
+        HTTP_CODE rejected;
+        uint64_t user_data;       // 处理者在一个请求内自用的数据，每个请求开始时为0
+        int param_count;          // 路由捕获的参数个数
+        // 路由捕获的参数，值的偏移相对于读缓冲区，与头部索引一样
+        route_param params[ROUTER_MAX_PARAMS];
+        // 客户请求的目标文件的完整路径，其内容等于doc_root+url,doc_root是网站根目录
+        char real_file[FILENAME_LEN];
+        // 目标文件在文件缓存中的条目，持有一个引用直到响应发送完毕
+        file_entry *file = nullptr;
+        // 请求头部的索引，按出现的顺序
+        header_field headers[MAX_HEADERS];
     };
 
     http_conn(){};
-    ~http_conn(){};
+    ~http_conn() {
+        release_buffers();
+        release_file();
+    };
 
     // 初始化新建立的连接
-    void init(int sockfd, const sockaddr_in &addr, bool et, util_timer *timer = nullptr);
+    void init(int sockfd, const sockaddr_in &addr, bool et, reactor *r,
+              util_timer *timer = nullptr);
     void close_conn();            // 关闭连接
     bool read();                  // 一次性读完（非阻塞）
     bool write();                 // 一次性写完（非阻塞）
     void process();               // 处理客户端请求
+    // 由reactor线程调用的快速路径：解析已收到的数据，请求不完整，或者目标文件在响应缓存中有完整的响应时
+    // 直接在当前线程处理完并返回true，由reactor接着接收(get_bytes_to_send()为0)或立即发送；
+    // 其余请求返回false交给线程池，解析结果保留下来，process()不再重复解析
+    bool process_inline();
+    // 读缓冲区中有已经解析完、留到下一批的流水线请求。这一批响应发送完后若返回true，
+    // reactor应当直接处理它(快速路径或线程池)，而不是等待下一个EPOLLIN
+    bool has_pending() const {
+        return m_cold->parsed != NO_REQUEST;
+    }
     sockaddr_in *get_address() {  // 获取IP地址
-        return &m_address;
+        return &m_cold->address;
+    }
+
+    // 请求头部，值是指向读缓冲区的视图，不拷贝，在请求处理完之前有效
+    // 按已知字段取值，O(1)；请求中没有这个字段时返回false，有多个时取第一个
+    bool get_header(HEADER h, std::string_view &value) const;
+    // 按名字取值，不区分大小写；已知字段经完美哈希直接定位，其余字段依次比较
+    bool get_header(std::string_view name, std::string_view &value) const;
+    int get_header_count() const {
+        return m_cold->header_count;
+    }
+    // 第i个头部的名字和值
+    void get_header_at(int i, std::string_view &name, std::string_view &value) const;
+    METHOD get_method() const {
+        return m_cold->method;
+    }
+    const char *get_url() const {
+        return m_cold->url;
+    }
+    // 路由捕获的参数，值是指向读缓冲区的视图；路由中没有这个参数时返回false
+    bool get_param(const char *name, std::string_view &value) const;
+    long long get_body_received() const {  // 已经收到的请求体字节数
+        return m_cold->body_received;
+    }
+    uint64_t &user_data() {
+        return m_cold->user_data;
+    }
+    // 正在接收请求体：头部已经解析完，请求体还没收完
+    bool reading_body() const {
+        return m_check_state == CHECK_STATE_CONTENT;
+    }
+    // 供处理者生成响应：状态行、Content-Length、Content-Type和Connection几行，再加上响应体；
+    // HEAD请求不带响应体。整个响应须放得下写缓冲区，否则返回false
+    bool reply(int status, const char *title, const char *content_type, const char *body,
+               int len);
+
+    // 以下接口供完成通知模型的事件后端(io_uring)使用，由后端代替read()/write()完成收发
+    int append_read(const char *data, int len);  // 把收到的数据追加到读缓冲区
+    struct iovec *get_iov(int &count) {          // 获取待发送的数据块
+        count = m_iv_count;
+        return m_iv;
+    }
+    int get_bytes_to_send() const {  // 获取剩余待发送的字节数
+        return bytes_to_send;
     }
+    // 响应体由后端直接从文件发送(sendfile/splice)时返回true，并给出文件、尚未发出的响应体的偏移和长度；
+    // 此时get_iov只包含响应头
+    bool get_file_body(int &fd, off_t &offset, int &len) const;
+    void advance_write(int len);  // 已发送len字节，调整待发送的数据块
+    bool finish_write();          // 响应发送完毕，返回是否保持连接
+    // 把读写缓冲区还给缓冲池。连接保持空闲时会自动归还，关闭的连接由reactor在释放对象时调用
+    void release_buffers();
+    void release_file();  // 归还目标文件的引用，同样由reactor在释放对象时调用
+
+    // 以下为热数据，按访问的先后集中在两个缓存行里
+    // 第一个缓存行：收到数据和解析请求时访问
+public:
+    int m_sockfd;  // 该http连接的socket
+    bool m_et;     // 是否开启ET模式
+
+private:
+    bool m_linger;              // 判断http请求是否要保持连接
+    bool m_sendfile;            // 响应体是否用sendfile从文件发送，而不是writev映射的内存
+    bool m_keep_alive;          // 正在发送的这一批响应发完后是否保持连接
+    CHECK_STATE m_check_state;  // 主状态机当前所处的状态
+    int m_read_idx;             // 标识读缓冲区中读入的数据最后一个字节的下标
+    int m_checked_idx;          // 当前正在分析的字符在读缓冲区的位置
+    int m_start_line;           // 当前正在解析的行的起始位置
+
+public:
+    reactor *m_reactor;   // 该连接所属的reactor，连接的事件只注册到accept它的reactor上；放回slab后为空
+    util_timer *m_timer;  // 定时器
 
 private:
-    sockaddr_in m_address;             // 通信的地址信息
-    char m_readbuf[READ_BUFFER_SIZE];  // 读缓冲区
-    int m_read_idx;        // 标识读缓冲区中读入的数据最后一个字节的下标
-    int m_checked_idx;     // 当前正在分析的字符在读缓冲区的位置
-    int m_start_line;      // 当前正在解析的行的起始位置
-    char *m_url;           // 请求目标文件的文件名
-    char *m_version;       // 请求目标文件的http协议版本，我们仅支持HTTP1.1
-    METHOD m_method;       // 请求方法
-    char *m_host;          // 主机名
-    bool m_linger;         // 判断http请求是否要保持连接
-                           // linger单词含义：萦绕，盘旋，逗留，拖延
-    int m_content_length;  // 内容长度
-    // 客户请求的目标文件的完整路径，其内容等于doc_root+m_url,doc_root是网站根目录
-    char m_real_file[FILENAME_LEN];
-    // 目标文件的状态。通过它我们可以判断文件是否存在、是否为目录、是否可读，并获取文件大小等信息
-    struct stat m_file_stat;
-    char *m_file_address;  // 客户请求的目标文件被mmap到内存中的起始位置
-    char m_write_buf[WRITE_BUFFER_SIZE];  // 写缓冲区
-    int m_write_idx;                      // 当前写缓冲区索引
-                                          //
+    char *m_readbuf = nullptr;    // 读缓冲区，没有未处理的请求时为空
+    char *m_write_buf = nullptr;  // 写缓冲区，没有待发送的响应时为空
+    int m_write_idx;              // 当前写缓冲区索引
+    int bytes_to_send;            // 要发送的字节数
+
+    // 第二个缓存行：生成和发送响应时访问
     // writev函数用于将多个分散的缓存区中的内容聚集在一起写入一个fd
     // 我们将采用writev来执行写操作，所以定义下面两个成员。
     // 为什么要聚集写？因为我们的写缓冲区只存了状态行、首行这些信息
@@ -124,32 +228,45 @@ private:
     // 最后我们响应的应该是两个东西连续起来
     // 因此需要聚集写入
     struct iovec m_iv[2];
-    // 表示被写内存块的数量，与上面的结构体一起使用
-    int m_iv_count;
+    char *m_file_address;        // 客户请求的目标文件被mmap到内存中的起始位置，映射由文件缓存管理
+    cold_data *m_cold = nullptr;  // 冷数据，由slab分配
+    int bytes_have_send;         // 已经发送的字节数
+    int m_iv_count;              // 表示被写内存块的数量，与上面的结构体一起使用
+    int m_read_cap = 0;          // 读缓冲区的大小
+    int m_write_cap = 0;         // 写缓冲区的大小
 
-    int bytes_to_send;    // 要发送的字节数
-    int bytes_have_send;  // 已经发送的字节数
-
-    CHECK_STATE m_check_state;  // 主状态机当前所处的状态
+    friend class conn_slab;  // slab为对象挂上冷数据
 
     HTTP_CODE process_read();                  // 解析HTTP请求
     HTTP_CODE parse_request_line(char *text);  // 解析请求首行
     HTTP_CODE parse_headers(char *text);       // 解析请求头
-    HTTP_CODE parse_content(char *text);       // 解析请求体
+    HTTP_CODE route();                         // 按方法和路径选出处理者
+    HTTP_CODE read_body();                     // 接收请求体，按块交给处理者
 
     LINE_STATUS parse_line();  // 解析一行
     HTTP_CODE do_request();    // 具体处理
+    void expect_continue();    // 需要时回复100 Continue
+    void build_real_file();    // 由根目录和url拼出目标文件的完整路径
     // 类体内直接生成函数体，则默认会设为内联函数，即使不加inline也是。
     // 返回读缓冲区指针后移
     char *get_line() {
         return m_readbuf + m_start_line;
     }
-    void init();   // 初始化状态机
-    void unmap();  // 取消文件的内存映射
+    void init();           // 初始化状态机，归还读写缓冲区和目标文件
+    void reset_request();  // 重置解析状态和请求字段，准备解析下一个请求
+    // 当前请求处理完，把读缓冲区中剩下的数据(流水线上的后续请求)挪到开头，准备解析下一个请求
+    void next_request();
+    // 当前响应已生成，接着解析流水线上的下一个请求，它完整并且响应还能追加到这一批时返回true
+    bool pipeline_next(HTTP_CODE &ret);
+    bool cacheable() const;       // 请求是否可能直接使用文件缓存中的完整响应
+    bool lookup_cached();         // 只在文件缓存中查找目标文件的完整响应，供快速路径使用
+    bool reserve_read(int len);   // 保证读缓冲区还能再放入len字节，超过上限时返回false
+    bool reserve_write(int len);  // 保证写缓冲区还能再放入len字节，超过上限时返回false
 
     bool process_write(HTTP_CODE ret);                    // 填充HTTP应答
     bool add_response(const char *format, ...);           // 写入一行响应
     bool add_content(const char *content);                // 写入内容
+    bool add_body(const char *content);                   // 写入响应体，HEAD请求不写
     bool add_content_type();                              // 写入内容类型
     bool add_status_line(int status, const char *title);  // 写入状态行
     bool add_headers(int content_length);                 // 写入首行
@@ -158,4 +275,7 @@ private:
     bool add_blank_line();                                // 添加空行
 };
 
+// 热数据正好占两个缓存行，增删字段时注意不要越过
+static_assert(sizeof(http_conn) == 128, "http_conn hot data should fit in two cache lines");
+
 #endif
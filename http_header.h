@@ -0,0 +1,106 @@
+#ifndef HTTP_HEADER_H
+#define HTTP_HEADER_H
+
+#include <stdint.h>
+#include <strings.h>
+
+#include <string_view>
+
+// 常见的请求头部字段。按名字识别时用编译期生成的完美哈希：算一次哈希、查一次表、比较一次名字
+enum HEADER {
+    HDR_HOST = 0,
+    HDR_CONNECTION,
+    HDR_CONTENT_LENGTH,
+    HDR_CONTENT_TYPE,
+    HDR_TRANSFER_ENCODING,
+    HDR_EXPECT,
+    HDR_USER_AGENT,
+    HDR_ACCEPT,
+    HDR_ACCEPT_ENCODING,
+    HDR_ACCEPT_LANGUAGE,
+    HDR_COOKIE,
+    HDR_REFERER,
+    HDR_ORIGIN,
+    HDR_AUTHORIZATION,
+    HDR_CACHE_CONTROL,
+    HDR_PRAGMA,
+    HDR_IF_MODIFIED_SINCE,
+    HDR_IF_NONE_MATCH,
+    HDR_RANGE,
+    HDR_UPGRADE,
+    HDR_X_FORWARDED_FOR,
+    HDR_COUNT,
+    HDR_UNKNOWN = HDR_COUNT  // 不在上面的字段
+};
+
+// 已知字段的规范写法，下标为HEADER
+inline constexpr std::string_view HEADER_NAMES[HDR_COUNT] = {
+    "Host", "Connection", "Content-Length", "Content-Type", "Transfer-Encoding", "Expect",
+    "User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Cookie", "Referer", "Origin",
+    "Authorization", "Cache-Control", "Pragma", "If-Modified-Since", "If-None-Match", "Range",
+    "Upgrade", "X-Forwarded-For",
+};
+
+// 字段名的哈希，FNV-1a，字母按小写计算；
+// |0x20对'-'和数字不起作用，其他字符即使被混淆也会在比较名字时排除
+constexpr uint32_t header_name_hash(const char *s, size_t len, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < len; ++i) {
+        h = (h ^ (uint8_t)(s[i] | 0x20)) * 16777619u;
+    }
+    return h;
+}
+
+#define HEADER_TABLE_SIZE 64  // 2的幂，取模就是取低位
+
+// 完美哈希表：选定的种子下，每个已知字段名落在不同的槽里
+struct header_table {
+    uint32_t seed;
+    int8_t slot[HEADER_TABLE_SIZE];  // 槽中的字段，-1表示空
+};
+
+// 在编译期从0开始逐个尝试种子，直到没有冲突
+constexpr header_table build_header_table() {
+    for (uint32_t seed = 0;; ++seed) {
+        header_table t = {seed, {}};
+        for (int i = 0; i < HEADER_TABLE_SIZE; ++i) {
+            t.slot[i] = -1;
+        }
+        bool ok = true;
+        for (int h = 0; h < HDR_COUNT && ok; ++h) {
+            uint32_t i =
+                header_name_hash(HEADER_NAMES[h].data(), HEADER_NAMES[h].size(), seed) %
+                HEADER_TABLE_SIZE;
+            if (t.slot[i] != -1) {
+                ok = false;
+            } else {
+                t.slot[i] = h;
+            }
+        }
+        if (ok) {
+            return t;
+        }
+    }
+}
+
+inline constexpr header_table HEADER_TABLE = build_header_table();
+
+// 识别字段名，不区分大小写，不是已知字段时返回HDR_UNKNOWN
+inline HEADER lookup_header(const char *name, size_t len) {
+    int h = HEADER_TABLE.slot[header_name_hash(name, len, HEADER_TABLE.seed) % HEADER_TABLE_SIZE];
+    if (h >= 0 && HEADER_NAMES[h].size() == len &&
+        strncasecmp(HEADER_NAMES[h].data(), name, len) == 0) {
+        return (HEADER)h;
+    }
+    return HDR_UNKNOWN;
+}
+
+// 一个请求头部在读缓冲区中的位置，名字和值都不拷贝；用偏移而不是指针，读缓冲区扩容搬家后仍然有效
+struct header_field {
+    uint16_t name;  // 名字的偏移
+    uint16_t name_len;
+    uint16_t value;  // 值的偏移，前后的空白不计在内
+    uint16_t value_len;
+};
+
+#endif
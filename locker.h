@@ -1,9 +1,13 @@
 #ifndef LOCKER_H
 #define LOCKER_H
 
+#include <linux/futex.h>
 #include <pthread.h>
 #include <semaphore.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
+#include <atomic>
 #include <exception>
 // 线程同步机制封装类
 
@@ -107,4 +111,19 @@ public:
         return sem_post(&m_sem) == 0;
     }
 };
+
+// futex：直接在一个整数上睡眠和唤醒，没有配套的互斥锁，条件由调用者自己用原子操作维护
+// wait只有在*addr仍等于expected时才会睡眠，否则立即返回；被唤醒后需要重新检查条件
+// timeout是相对时间，为NULL时一直等待
+static_assert(sizeof(std::atomic<int>) == sizeof(int), "futex需要atomic<int>与int布局相同");
+
+inline void futex_wait(std::atomic<int> *addr, int expected,
+                       const struct timespec *timeout = NULL) {
+    syscall(SYS_futex, reinterpret_cast<int *>(addr), FUTEX_WAIT_PRIVATE, expected, timeout, NULL,
+            0);
+}
+
+inline void futex_wake(std::atomic<int> *addr, int n) {
+    syscall(SYS_futex, reinterpret_cast<int *>(addr), FUTEX_WAKE_PRIVATE, n, NULL, NULL, 0);
+}
 #endif
@@ -143,7 +143,11 @@ void Log::write_log(LOGLEVEL level, const char *format, ...) {
                      my_tm.tm_mon + 1, my_tm.tm_mday, my_tm.tm_hour, my_tm.tm_min, my_tm.tm_sec,
                      now.tv_usec, s);
     // m_buf: "2023-03-15 12:47:03.μs [debug]:close fd"
-    int m = vsnprintf(m_buf + n, m_log_buf_size - 1, format, valst);
+    // 留两个字节给换行符和结束符，过长的内容被截断(vsnprintf返回的是完整内容的长度)
+    int m = vsnprintf(m_buf + n, m_log_buf_size - n - 1, format, valst);
+    if (m > m_log_buf_size - n - 2) {
+        m = m_log_buf_size - n - 2;
+    }
 
     // 设置换行符和字符串终止符
     m_buf[n + m] = '\n';
@@ -10,10 +10,13 @@
 // 定时器类
 class util_timer {
 public:
-    util_timer() : prev(NULL), next(NULL) {}
+    util_timer() : deadline(0), kind(0), index(-1), prev(NULL), next(NULL) {}
 
 public:
-    time_t expire;  // 任务超时时间，这里使用绝对时间
+    long long expire;    // 任务超时时间，这里使用绝对时间(CLOCK_MONOTONIC，毫秒)
+    long long deadline;  // 惰性刷新时记下的真正超时时间，到期时若它还没到就重新放回容器
+    int kind;          // 超时类型，见reactor::TIMEOUT
+    int index;         // 定时器在容器中的位置：时间轮中为所在的槽，时间堆中为堆数组下标，链表不使用
     // 任务回调函数，回调函数处理的客户数据，由定时器的执行者传递给回调函数
     void (*callback)(http_conn *);
     http_conn *user_data;
@@ -21,8 +24,97 @@ public:
     util_timer *next;  // 指向后一个定时器
 };
 
+// 定时器容器的公共接口，reactor根据启动参数选择具体的实现
+// 容器负责定时器对象的分配与回收：定时器被删除或到期后放入空闲链表，留给下一个连接复用
+class timer_queue {
+public:
+    timer_queue() : m_lazy(false), m_lazy_refreshes(0), m_rescheduled(0), free_head(NULL) {}
+    // 删除空闲链表中缓存的定时器，容器中剩余的定时器由派生类删除
+    virtual ~timer_queue() {
+        util_timer *del = free_head;
+        while (del != nullptr) {
+            free_head = del->next;
+            delete del;
+            del = free_head;
+        }
+    }
+
+    // 获取一个定时器，优先复用被删除的定时器，避免每个新连接都new一次
+    util_timer *get_timer() {
+        if (free_head == nullptr) {
+            return new util_timer;
+        }
+        util_timer *timer = free_head;
+        free_head = timer->next;
+        timer->next = NULL;
+        timer->deadline = 0;
+        return timer;
+    }
+
+    // 惰性刷新：连接有活动时只记下新的超时时间，不调整定时器的位置，
+    // 等定时器到期时再检查，没有真正超时就按记下的时间重新放回容器。
+    // 长连接上每秒成千上万次的刷新因此只在到期时重排一次
+    void set_lazy(bool lazy) {
+        m_lazy = lazy;
+    }
+    // 把定时器的超时时间改为deadline。惰性模式下只有超时时间提前时才需要立即调整位置
+    void refresh_timer(util_timer *timer, long long deadline) {
+        timer->deadline = deadline;
+        if (m_lazy && deadline >= timer->expire) {
+            ++m_lazy_refreshes;
+            return;
+        }
+        timer->expire = deadline;
+        adjust_timer(timer);
+    }
+    // 惰性刷新省去的调整次数，以及到期后重新放回容器的次数，二者之差就是节省下来的调整次数
+    unsigned long long lazy_refreshes() const {
+        return m_lazy_refreshes;
+    }
+    unsigned long long rescheduled() const {
+        return m_rescheduled;
+    }
+
+    virtual void add_timer(util_timer *timer) = 0;
+    // 定时器的超时时间被修改后，调整它在容器中的位置
+    virtual void adjust_timer(util_timer *timer) = 0;
+    // 删除定时器，定时器随即被回收，调用者不能再使用它
+    virtual void del_timer(util_timer *timer) = 0;
+    // 处理所有在now之前到期的定时器，now为调用者取得的当前时间，毫秒
+    virtual void tick(long long now) = 0;
+    // 下一次需要调用tick()的时间，容器为空时返回-1。
+    // 可以早于真正最早的超时时间，但不能晚于它
+    virtual long long next_expire() const = 0;
+
+protected:
+    // 到期的定时器是否被惰性刷新过而还没有真正超时。是则把expire改为真正的超时时间，
+    // 由调用者把它重新放回容器
+    bool reschedule(util_timer *timer, long long now) {
+        if (timer->deadline <= now) {
+            return false;
+        }
+        timer->expire = timer->deadline;
+        ++m_rescheduled;
+        return true;
+    }
+
+    // 被删除的定时器放入空闲链表，留给下一个连接复用
+    void recycle(util_timer *timer) {
+        timer->prev = NULL;
+        timer->next = free_head;
+        free_head = timer;
+    }
+
+private:
+    bool m_lazy;                           // 是否惰性刷新
+    unsigned long long m_lazy_refreshes;  // 惰性刷新的次数
+    unsigned long long m_rescheduled;     // 到期后重新放回容器的次数
+    util_timer *free_head;                // 空闲定时器链表，只用next串联
+};
+
 // 定时器链表，它是一个升序、双向链表，且带有头节点和尾节点。
-class sort_timer_lst {
+// 插入和延长超时时间都需要遍历链表，适合连接数较少的场景
+class sort_timer_lst : public timer_queue {
 public:
     sort_timer_lst() : head(NULL), tail(NULL) {}
     // 链表被销毁时，删除其中所有的定时器
@@ -57,12 +149,23 @@ public:
         add_timer(timer, head);  // 否则找到该插的位置
     }
 
-    /* 当某个定时任务发生变化时，调整对应的定时器在链表中的位置。这个函数只考虑被调整的定时器的
-    超时时间延长的情况，即该定时器需要往链表的尾部移动。*/
+    /* 当某个定时任务发生变化时，调整对应的定时器在链表中的位置。不同阶段的超时时间不同，
+    超时时间可能缩短，此时把定时器取出后从头插入；延长时定时器需要往链表的尾部移动。*/
     void adjust_timer(util_timer *timer) {
         if (timer == nullptr) {
             return;
         }
+        if (timer->prev != nullptr && timer->expire < timer->prev->expire) {
+            timer->prev->next = timer->next;
+            if (timer == tail) {
+                tail = timer->prev;
+            } else {
+                timer->next->prev = timer->prev;
+            }
+            timer->prev = timer->next = NULL;
+            add_timer(timer);
+            return;
+        }
         util_timer *tmp = timer->next;
         // 如果被调整的目标定时器处在链表的尾部，或者该定时器新的超时时间值仍然小于其下一个定时器的超时时间
         // 则不用调整
@@ -89,7 +192,7 @@ public:
         }
         // 下面这个条件成立表示链表中只有一个定时器，即目标定时器
         if ((timer == head) && (timer == tail)) {
-            delete timer;
+            recycle(timer);
             head = NULL;
             tail = NULL;
             return;
@@ -99,7 +202,7 @@ public:
         if (timer == head) {
             head = head->next;
             head->prev = NULL;
-            delete timer;
+            recycle(timer);
             return;
         }
         /* 如果链表中至少有两个定时器，且目标定时器是链表的尾节点，
@@ -107,23 +210,27 @@ public:
         if (timer == tail) {
             tail = tail->prev;
             tail->next = NULL;
-            delete timer;
+            recycle(timer);
             return;
         }
         // 如果目标定时器位于链表的中间，则把它前后的定时器串联起来，然后删除目标定时器
         timer->prev->next = timer->next;
         timer->next->prev = timer->prev;
-        delete timer;
+        recycle(timer);
+    }
+
+    // 最早的超时时间，链表为空时返回-1
+    long long next_expire() const {
+        return head == nullptr ? -1 : head->expire;
     }
 
-    // SIGALARM 信号每次被触发就在其信号处理函数中执行一次 tick()
-    // 函数，以处理链表上到期任务。
-    void tick() {
+    // timerfd 每次到期就执行一次 tick() 函数，以处理链表上到期任务。
+    // now为调用者取得的当前时间，毫秒
+    void tick(long long now) {
         if (head == nullptr) {
             return;
         }
-        // printf("timer tick!\n");
-        time_t deadline = time(NULL);  // 获取当前系统时间
+        long long deadline = now;
         util_timer *cur = head;
         // 从头节点开始依次处理每个定时器，直到遇到一个尚未到期的定时器
         // 由于定时器是升序，故遇到第一个没到期的，后面的所有都没到期
@@ -134,14 +241,21 @@ public:
                 break;
             }
 
-            // 调用定时器的回调函数，以执行定时任务
-            cur->callback(cur->user_data);
-            // 执行完定时器中的定时任务之后，就将它从链表中删除，并重置链表头节点
+            // 将它从链表中删除，并重置链表头节点
             head = cur->next;
             if (head != nullptr) {
                 head->prev = NULL;
             }
-            delete cur;
+            cur->next = NULL;
+            // 惰性刷新过的定时器还没有真正超时，按新的超时时间重新插入
+            if (reschedule(cur, deadline)) {
+                add_timer(cur);
+                cur = head;
+                continue;
+            }
+            // 调用定时器的回调函数，以执行定时任务，执行完之后回收定时器
+            cur->callback(cur->user_data);
+            recycle(cur);
             cur = head;
         }
     }
@@ -0,0 +1,177 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <atomic>
+
+// 定长的无锁多生产者多消费者队列(Dmitry Vyukov的有界MPMC队列)
+// 每个格子带一个序号：序号等于pos时格子可写，等于pos+1时可读，读走后改为pos+容量留给下一圈；
+// 生产者和消费者各自用CAS抢下一个位置，抢到后只访问自己的格子，互相之间不需要锁
+template <typename T>
+class mpmc_queue {
+private:
+    struct cell {
+        std::atomic<size_t> seq;
+        T data;
+    };
+
+    cell *m_cells;
+    size_t m_mask;  // 容量-1，容量为2的幂
+    // 入队和出队位置分别由生产者和消费者修改，各占一个缓存行
+    alignas(64) std::atomic<size_t> m_enqueue_pos;
+    alignas(64) std::atomic<size_t> m_dequeue_pos;
+    char m_pad[64 - sizeof(std::atomic<size_t>)];
+
+public:
+    // 容量向上取整到2的幂
+    explicit mpmc_queue(size_t capacity) : m_enqueue_pos(0), m_dequeue_pos(0) {
+        size_t cap = 2;
+        while (cap < capacity) {
+            cap <<= 1;
+        }
+        m_cells = new cell[cap];
+        m_mask = cap - 1;
+        for (size_t i = 0; i < cap; ++i) {
+            m_cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~mpmc_queue() {
+        delete[] m_cells;
+    }
+
+    mpmc_queue(const mpmc_queue &) = delete;
+    mpmc_queue &operator=(const mpmc_queue &) = delete;
+
+    // 队列满时返回false
+    bool push(const T &value) {
+        cell *c;
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0) {
+                if (m_enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                                                        std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                // 这个格子上一圈的数据还没被取走
+                return false;
+            } else {
+                // 别的生产者已经抢先写了这个位置
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        c->data = value;
+        c->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 队列空时返回false
+    bool pop(T &value) {
+        cell *c;
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            c = &m_cells[pos & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0) {
+                if (m_dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                                                        std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (dif < 0) {
+                return false;
+            } else {
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+        value = c->data;
+        c->seq.store(pos + m_mask + 1, std::memory_order_release);
+        return true;
+    }
+
+    // 批量入队：一次CAS占下连续的若干个空格子，make(i)生成第i个元素
+    // 最多放入n个，空格子不够时只放入能放下的部分，返回实际放入的个数
+    template <typename F>
+    size_t push_bulk(size_t n, F make) {
+        size_t pos = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_t k;
+        for (;;) {
+            // 从pos开始数连续可写的格子
+            for (k = 0; k < n; ++k) {
+                size_t seq = m_cells[(pos + k) & m_mask].seq.load(std::memory_order_acquire);
+                if (seq != pos + k) {
+                    break;
+                }
+            }
+            if (k == 0) {
+                intptr_t dif = (intptr_t)m_cells[pos & m_mask].seq.load(std::memory_order_acquire) -
+                               (intptr_t)pos;
+                if (dif < 0) {
+                    return 0;
+                }
+                pos = m_enqueue_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_enqueue_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < k; ++i) {
+            cell &c = m_cells[(pos + i) & m_mask];
+            c.data = make(i);
+            c.seq.store(pos + i + 1, std::memory_order_release);
+        }
+        return k;
+    }
+
+    // 批量出队：一次CAS取走连续的至多n个元素，返回实际取到的个数
+    size_t pop_bulk(T *out, size_t n) {
+        size_t pos = m_dequeue_pos.load(std::memory_order_relaxed);
+        size_t k;
+        for (;;) {
+            for (k = 0; k < n; ++k) {
+                size_t seq = m_cells[(pos + k) & m_mask].seq.load(std::memory_order_acquire);
+                if (seq != pos + k + 1) {
+                    break;
+                }
+            }
+            if (k == 0) {
+                intptr_t dif = (intptr_t)m_cells[pos & m_mask].seq.load(std::memory_order_acquire) -
+                               (intptr_t)(pos + 1);
+                if (dif < 0) {
+                    return 0;
+                }
+                pos = m_dequeue_pos.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (m_dequeue_pos.compare_exchange_weak(pos, pos + k, std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (size_t i = 0; i < k; ++i) {
+            cell &c = m_cells[(pos + i) & m_mask];
+            out[i] = c.data;
+            c.seq.store(pos + i + m_mask + 1, std::memory_order_release);
+        }
+        return k;
+    }
+
+    // 当前的元素个数，并发修改时只是一个近似值，用于统计
+    size_t size() const {
+        size_t tail = m_enqueue_pos.load(std::memory_order_relaxed);
+        size_t head = m_dequeue_pos.load(std::memory_order_relaxed);
+        return tail > head ? tail - head : 0;
+    }
+
+    size_t capacity() const {
+        return m_mask + 1;
+    }
+};
+
+#endif
@@ -0,0 +1,439 @@
+#include "reactor.h"
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <linux/filter.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "buffer_pool.h"
+#include "cpu_affinity.h"
+#include "epoll_reactor.h"
+#include "file_cache.h"
+#include "heap_timer.h"
+#include "log.h"
+#include "time_wheel.h"
+#include "uring_reactor.h"
+
+reactor *reactor::create(int id, const server_config &cfg, conn_table *conns,
+                         threadpool<http_conn> *pool) {
+    if (cfg.backend == server_config::BACKEND_URING) {
+        return new uring_reactor(id, cfg, conns, pool);
+    }
+    return new epoll_reactor(id, cfg, conns, pool);
+}
+
+reactor::reactor(int id, const server_config &cfg, conn_table *conns, threadpool<http_conn> *pool)
+    : m_id(id),
+      m_cpu(cfg.cpus.empty() ? -1 : cfg.cpus[id % cfg.cpus.size()]),
+      m_cfg(cfg),
+      m_conns(conns),
+      m_pool(pool),
+      m_listenfd(-1),
+      m_timerfd(-1),
+      m_sigfd(-1),
+      m_wakefd(-1),
+      m_stop(false),
+      m_timers(NULL),
+      m_now(0),
+      m_timer_armed(0),
+      m_accept_count(0),
+      m_last_accept_count(0),
+      m_last_stat_time(0),
+      m_local_accept_count(0),
+      m_last_local_accept_count(0),
+      m_started(false) {
+    if (cfg.timer == server_config::TIMER_WHEEL) {
+        m_timers = new time_wheel;
+    } else if (cfg.timer == server_config::TIMER_HEAP) {
+        m_timers = new TimeHeap(1024);
+    } else {
+        m_timers = new sort_timer_lst;
+    }
+    update_time();
+    // 让定时器容器以当前时间为起点
+    m_timers->set_lazy(cfg.lazy_timer);
+    m_timers->tick(m_now);
+    m_last_stat_time = m_now;
+}
+
+reactor::~reactor() {
+    int fds[] = {m_listenfd, m_timerfd, m_sigfd, m_wakefd};
+    for (size_t i = 0; i < sizeof(fds) / sizeof(fds[0]); ++i) {
+        if (fds[i] != -1) {
+            close(fds[i]);
+        }
+    }
+    delete m_timers;
+}
+
+void reactor::shutdown_signals(sigset_t *set) {
+    sigemptyset(set);
+    sigaddset(set, SIGTERM);
+    sigaddset(set, SIGINT);
+}
+
+bool reactor::init() {
+    // 创建socket，监听socket本身就是非阻塞的，不必再fcntl
+    m_listenfd = socket(PF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (m_listenfd == -1) {
+        perror("socket");
+        return false;
+    }
+
+    // 设置端口复用
+    // 为什么？如果不设置，服务器关闭后，再重启，之前绑定的端口号还未释放，或程序突然退出而系统未释放端口号，
+    // 会导致绑定失败，提示ADDR正在使用中。
+    // 该选项只对监听socket有意义，accept得到的连接不必再设置
+    int reuse = 1;
+    int ret = setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    if (ret == -1) {
+        perror("setsockopt reuseaddr");
+        return false;
+    }
+
+    // 多个reactor各自绑定同一端口，由内核按四元组哈希把新连接分发到各个监听socket上
+    if (m_cfg.reactors > 1) {
+        ret = setsockopt(m_listenfd, SOL_SOCKET, SO_REUSEPORT, &reuse, sizeof(reuse));
+        if (ret == -1) {
+            perror("setsockopt reuseport");
+            return false;
+        }
+    }
+
+    // 绑核时让内核优先把在本CPU上收到的连接交给这个监听socket
+    if (m_cpu >= 0) {
+        ret = setsockopt(m_listenfd, SOL_SOCKET, SO_INCOMING_CPU, &m_cpu, sizeof(m_cpu));
+        if (ret == -1) {
+            perror("setsockopt incoming cpu");
+            return false;
+        }
+    }
+
+    // 绑定
+    struct sockaddr_in saddr;
+    saddr.sin_addr.s_addr = INADDR_ANY;
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = htons(m_cfg.port);
+    ret = bind(m_listenfd, (struct sockaddr *)&saddr, sizeof(saddr));
+    if (ret == -1) {
+        perror("bind");
+        return false;
+    }
+
+    // 监听，全连接队列开到系统上限，连接风暴时由accept批量取走
+    ret = listen(m_listenfd, SOMAXCONN);
+    if (ret == -1) {
+        perror("listen");
+        return false;
+    }
+
+    // 监听组中socket的下标就是listen的先后顺序，reactor按编号依次初始化，下标即reactor编号，
+    // 组建好后挂上的程序对之后加入的socket同样有效
+    if (m_id == 0 && !attach_cpu_steering()) {
+        perror("setsockopt attach reuseport cbpf");
+        return false;
+    }
+
+    // 超时检测不再依赖SIGALRM：timerfd的到期时间始终设为最早的超时时间，与其他事件一起等待
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerfd == -1) {
+        perror("timerfd_create");
+        return false;
+    }
+
+    m_wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakefd == -1) {
+        perror("eventfd");
+        return false;
+    }
+
+    // 信号已在main中被所有线程屏蔽，一个信号只能被读取一次，因此只由0号reactor读取
+    if (m_id == 0) {
+        sigset_t mask;
+        shutdown_signals(&mask);
+        m_sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (m_sigfd == -1) {
+            perror("signalfd");
+            return false;
+        }
+    }
+    return true;
+}
+
+// 新版内核在SO_REUSEPORT组内按四元组哈希选择socket，监听socket上的SO_INCOMING_CPU不再起作用，
+// 只能由挂在组上的程序来选：程序读出收到SYN的CPU，与各reactor绑定的CPU比较，返回同核reactor的下标。
+// 没有reactor绑定在该CPU上时返回越界的下标，内核退回按哈希选择。
+// 只有每个reactor各占一个CPU时才有意义，否则不挂程序
+bool reactor::attach_cpu_steering() {
+    int n = m_cfg.reactors;
+    if (n <= 1 || m_cfg.cpus.empty() || (size_t)n > m_cfg.cpus.size()) {
+        return true;
+    }
+    std::vector<struct sock_filter> code;
+    struct sock_filter load = BPF_STMT(BPF_LD | BPF_W | BPF_ABS, (unsigned)(SKF_AD_OFF + SKF_AD_CPU));
+    code.push_back(load);
+    for (int i = 0; i < n; ++i) {
+        struct sock_filter cmp = BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, (unsigned)m_cfg.cpus[i], 0, 1);
+        struct sock_filter ret = BPF_STMT(BPF_RET | BPF_K, (unsigned)i);
+        code.push_back(cmp);
+        code.push_back(ret);
+    }
+    struct sock_filter fallback = BPF_STMT(BPF_RET | BPF_K, (unsigned)n);
+    code.push_back(fallback);
+
+    struct sock_fprog prog;
+    prog.len = code.size();
+    prog.filter = code.data();
+    return setsockopt(m_listenfd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog)) == 0;
+}
+
+void *reactor::worker(void *arg) {
+    reactor *r = (reactor *)arg;
+    r->loop();
+    return NULL;
+}
+
+bool reactor::start() {
+    // 绑核时线程一创建就在自己的CPU上，事件循环中分配的内存都落在本地节点
+    if (create_pinned_thread(&m_thread, m_cpu, worker, this) != 0) {
+        return false;
+    }
+    m_started = true;
+    return true;
+}
+
+void reactor::join() {
+    if (m_started) {
+        pthread_join(m_thread, NULL);
+        m_started = false;
+    }
+}
+
+void reactor::stop() {
+    m_stop = true;
+    uint64_t one = 1;
+    ::write(m_wakefd, &one, sizeof(one));
+}
+
+// 定时器回调函数，该函数就是httpconn类中的close_conn()函数
+void reactor::time_out_callback(http_conn *user) {
+    // 已经放回slab的连接
+    if (user->m_reactor == NULL) {
+        return;
+    }
+    // 每个关闭的连接都会走到这里，超时风暴时也不能每次都刷新日志文件
+    LOG_DEBUG("time out. close fd: %d", user->m_sockfd);
+    // 定时器随后会被释放，连接不能再引用它
+    user->m_timer = NULL;
+    user->close_conn();
+    user->m_reactor->release_conn(user);
+}
+
+void reactor::release_conn(http_conn *user) {
+    // 缓冲区可能正被工作线程使用，只有连接交还之后才能关闭，因此这里归还时没有其他线程持有它们；
+    // m_reactor清空后再次调用不会把缓冲区和对象重复放回
+    if (user->m_sockfd == -1 && user->m_timer == NULL && user->m_reactor == this) {
+        user->release_buffers();
+        user->release_file();
+        user->m_reactor = NULL;
+        m_slab.free(user);
+    }
+}
+
+// timerfd到期，实际上就是调用tick()函数
+void reactor::deal_timer() {
+    uint64_t expirations;
+    ::read(m_timerfd, &expirations, sizeof(expirations));
+    m_timer_armed = 0;
+    // tick函数从链表中找到那些到期的timer，并进行callback处理
+    m_timers->tick(m_now);
+}
+
+void reactor::after_loop() {
+    // 只有最早的超时时间比已设置的到期时间更早时才需要重新设置timerfd。
+    // 连接的超时时间被延长时不去推迟timerfd，到期后若没有连接真正超时，再按新的最早时间设置，
+    // 这样频繁刷新的连接不会让每轮循环都多一次timerfd_settime
+    long long next = m_timers->next_expire();
+    if (next > 0 && (m_timer_armed == 0 || next < m_timer_armed)) {
+        struct itimerspec its;
+        memset(&its, 0, sizeof(its));
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000;
+        timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, NULL);
+        m_timer_armed = next;
+    }
+
+    // 统计每秒新建的连接数
+    long long elapsed = m_now - m_last_stat_time;
+    if (elapsed >= STAT_INTERVAL) {
+        LOG_INFO("reactor %d accepted %llu connections, %.1f conn/s", m_id, m_accept_count,
+                 (double)(m_accept_count - m_last_accept_count) * 1000 / elapsed);
+        LOG_INFO("reactor %d connections: %zu live, %zu allocated (%zu KB)", m_id, m_slab.live(),
+                 m_slab.capacity(), m_slab.capacity() * sizeof(http_conn) / 1024);
+        LOG_INFO("reactor %d timer refresh: %llu lazy, %llu rescheduled at expiry, %llu saved",
+                 m_id, m_timers->lazy_refreshes(), m_timers->rescheduled(),
+                 m_timers->lazy_refreshes() - m_timers->rescheduled());
+        if (m_cpu >= 0) {
+            unsigned long long accepted = m_accept_count - m_last_accept_count;
+            unsigned long long local = m_local_accept_count - m_last_local_accept_count;
+            LOG_INFO("reactor %d on cpu %d (node %d): %llu of %llu new connections "
+                     "received on this cpu",
+                     m_id, m_cpu, cpu_node(m_cpu), local, accepted);
+            m_last_local_accept_count = m_local_accept_count;
+        }
+        // 线程池、缓冲池和文件缓存由所有reactor共享，只由0号reactor输出
+        if (m_id == 0) {
+            log_pool_stats();
+            LOG_INFO("buffer pool: %zu x 4K, %zu x 16K, %zu x 64K allocated",
+                     buffer_pool::allocated(0), buffer_pool::allocated(1),
+                     buffer_pool::allocated(2));
+            size_t entries, bytes, hits, misses;
+            file_cache::stats(entries, bytes, hits, misses);
+            LOG_INFO("file cache: %zu files, %zu KB, %zu hits, %zu misses", entries, bytes / 1024,
+                     hits, misses);
+            file_cache::response_stats(bytes, hits, misses);
+            LOG_INFO("response cache: %zu bytes, %zu hits, %zu misses, hit ratio %.1f%%", bytes,
+                     hits, misses,
+                     hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0);
+        }
+        Log::get_instance()->flush();
+        m_last_accept_count = m_accept_count;
+        m_last_stat_time = m_now;
+    }
+}
+
+// 输出线程池的排队数、拒绝数，以及上次统计以来任务排队等待和执行时间的分位数(微秒)
+void reactor::log_pool_stats() {
+    histogram_snapshot wait, service;
+    m_pool->latency(wait, service);
+    histogram_snapshot wait_delta = wait, service_delta = service;
+    wait_delta.subtract(m_last_wait);
+    service_delta.subtract(m_last_service);
+    m_last_wait = wait;
+    m_last_service = service;
+
+    LOG_INFO("thread pool: %d threads (%d-%d), %llu grown, %llu shrunk, %d queued, %llu rejected",
+             m_pool->thread_num(), m_pool->min_threads(), m_pool->max_threads(),
+             m_pool->grow_count(), m_pool->shrink_count(), m_pool->size(), m_pool->rejected());
+    LOG_INFO("thread pool: %llu tasks, wait p50 %.1fus p99 %.1fus p999 %.1fus, "
+             "service p50 %.1fus p99 %.1fus p999 %.1fus",
+             (unsigned long long)service_delta.total, wait_delta.percentile(0.5) / 1000.0,
+             wait_delta.percentile(0.99) / 1000.0, wait_delta.percentile(0.999) / 1000.0,
+             service_delta.percentile(0.5) / 1000.0, service_delta.percentile(0.99) / 1000.0,
+             service_delta.percentile(0.999) / 1000.0);
+}
+
+bool reactor::add_conn(int connfd, const sockaddr_in &addr) {
+    // 目前连接数满了
+    if (http_conn::m_user_count >= MAX_FD) {
+        // 给客户端返回信息，服务器正忙，并关闭连接
+        close(connfd);
+        LOG_ERROR("%s", "Internal server busy");
+        return false;
+    }
+    // 连接对象从slab中分配，放入fd表，定时器从链表的空闲定时器中复用
+    http_conn *user = m_slab.alloc();
+    m_conns->set(connfd, user);
+    util_timer *timer = m_timers->get_timer();
+    timer->user_data = user;
+    timer->callback = time_out_callback;
+    // 新连接须在请求读取超时内发来完整的请求，当前时间每轮事件循环只取一次
+    timer->kind = TIMEOUT_HEADER;
+    timer->expire = m_now + m_cfg.header_timeout;
+
+    user->init(connfd, addr, m_cfg.et, this, timer);
+    m_timers->add_timer(timer);
+    ++m_accept_count;
+    if (m_cpu >= 0) {
+        int cpu = -1;
+        socklen_t len = sizeof(cpu);
+        if (getsockopt(connfd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len) == 0 && cpu == m_cpu) {
+            ++m_local_accept_count;
+        }
+    }
+    return true;
+}
+
+// 按连接所处的阶段重新计算超时时间
+// 惰性模式下只记下新的超时时间，定时器到期时再调整位置
+void reactor::refresh_timer(int sockfd, int kind) {
+    util_timer *timer = conn(sockfd)->m_timer;
+    if (timer == nullptr) {
+        return;
+    }
+    // 同一个请求分多次到达时不延长读取超时，避免慢速发送的客户端一直占住连接
+    if (kind == TIMEOUT_HEADER && timer->kind == TIMEOUT_HEADER) {
+        return;
+    }
+    int timeout = m_cfg.header_timeout;
+    if (kind == TIMEOUT_IDLE) {
+        timeout = m_cfg.keepalive_timeout;
+    } else if (kind == TIMEOUT_WRITE) {
+        timeout = m_cfg.write_timeout;
+    } else if (kind == TIMEOUT_BODY) {
+        timeout = m_cfg.body_timeout;
+    }
+    timer->kind = kind;
+    m_timers->refresh_timer(timer, m_now + timeout);
+}
+
+// 一次epoll_wait/一批完成事件中读到完整请求的连接一起投递，
+// 线程池只为每段任务做一次入队和至多一次唤醒，而不是每个连接一次
+void reactor::flush_tasks() {
+    if (m_ready.empty()) {
+        return;
+    }
+    int done = m_pool->append_batch(m_ready.data(), (int)m_ready.size(), m_cpu);
+    for (size_t i = done; i < m_ready.size(); ++i) {
+        reject(m_ready[i]->m_sockfd);
+    }
+    m_ready.clear();
+}
+
+void reactor::reject(int sockfd) {
+    // 队列满说明工作线程已经处理不过来，继续排队只会让连接挂着直到超时，
+    // 不如立即告诉客户端稍后重试。socket是非阻塞的，发不出去也不等待
+    static const char busy[] =
+        "HTTP/1.1 503 Service Unavailable\r\n"
+        "Content-Length: 0\r\n"
+        "Connection: close\r\n\r\n";
+    send(sockfd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+    LOG_WARN("thread pool full, reject the client(fd %d)", sockfd);
+    close_timer(sockfd);
+}
+
+// 服务器端关闭连接，移除对应的定时器
+void reactor::close_timer(int sockfd) {
+    util_timer *timer = conn(sockfd)->m_timer;
+    time_out_callback(conn(sockfd));
+    // timer还存在，就删除timer
+    if (timer) {
+        m_timers->del_timer(timer);
+    }
+}
+
+void reactor::deal_signal() {
+    struct signalfd_siginfo info[16];
+    int ret = ::read(m_sigfd, info, sizeof(info));
+    if (ret <= 0) {
+        return;
+    }
+    for (size_t i = 0; i < ret / sizeof(info[0]); ++i) {
+        if (info[i].ssi_signo == SIGTERM || info[i].ssi_signo == SIGINT) {
+            m_stop = true;
+        }
+    }
+}
+
+void reactor::deal_wakeup() {
+    uint64_t cnt;
+    ::read(m_wakefd, &cnt, sizeof(cnt));
+}
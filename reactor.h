@@ -0,0 +1,147 @@
+#ifndef REACTOR_H
+#define REACTOR_H
+
+#include <netinet/in.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include <atomic>
+#include <vector>
+
+#include "config.h"
+#include "conn_slab.h"
+#include "http_conn.h"
+#include "lst_timer.h"
+#include "threadpool.h"
+
+#define MAX_FD 65535         // 最大的文件描述符个数
+#define MAX_EVENT_NUM 10000  // 一次监听最大的事件数量
+#define STAT_INTERVAL 5000   // 建连速率统计间隔5s
+
+// 一个reactor就是一个独立的事件循环：
+// 拥有自己的监听socket(多reactor时开启SO_REUSEPORT，由内核在各监听socket间分发连接)、
+// 自己的事件后端实例、自己的定时器容器，以及连接表中属于自己的那一部分。
+// 连接由哪个reactor accept，之后的读写和超时处理就一直留在该reactor上。
+//
+// 具体如何等待和收发数据由事件后端决定，目前有两种：
+// epoll_reactor：就绪通知模型，reactor线程负责recv/writev
+// uring_reactor：完成通知模型，accept/recv/send都交给io_uring异步完成
+class reactor {
+public:
+    // 根据启动参数创建对应事件后端的reactor
+    static reactor *create(int id, const server_config &cfg, conn_table *conns,
+                           threadpool<http_conn> *pool);
+    virtual ~reactor();
+
+    // 超时类型，连接在不同阶段使用不同的超时时间
+    enum TIMEOUT {
+        TIMEOUT_HEADER = 0,  // 读取请求：从请求的第一个字节开始计时，期间收到数据不延长
+        TIMEOUT_IDLE,        // 保持连接：响应发送完毕后等待下一个请求
+        TIMEOUT_WRITE,       // 发送响应：每次有发送进展就重新计时
+        TIMEOUT_BODY         // 接收请求体：每次收到数据就重新计时，大的上传不受读取请求的时限限制
+    };
+
+    // 退出事件循环的信号，main须在创建任何线程之前把它们屏蔽掉，之后由0号reactor通过signalfd读取
+    static void shutdown_signals(sigset_t *set);
+
+    // 创建监听socket、timerfd、唤醒用的eventfd，0号reactor还会创建signalfd，失败返回false
+    virtual bool init();
+    // 事件循环，直到收到SIGTERM/SIGINT或被stop()
+    virtual void loop() = 0;
+    // 在新线程中运行事件循环
+    bool start();
+    // 等待事件循环线程退出
+    void join();
+    // 通知事件循环退出，可在其他线程中调用
+    void stop();
+
+    // 以下两个接口可能在工作线程中调用
+    // 连接处理完毕，重新监听读事件(EPOLLIN)或写事件(EPOLLOUT)
+    virtual void rearm(http_conn *conn, int ev) = 0;
+    // 注销连接，fd由http_conn::close_conn()关闭。返回false表示连接正被工作线程使用，
+    // 关闭被推迟到工作线程交还连接之后
+    virtual bool remove(http_conn *conn) = 0;
+
+protected:
+    reactor(int id, const server_config &cfg, conn_table *conns, threadpool<http_conn> *pool);
+
+    static void time_out_callback(http_conn *user);
+
+    http_conn *conn(int fd) const {
+        return m_conns->get(fd);
+    }
+    // 从slab中取一个连接对象初始化新接受的连接并为其添加定时器，连接数已满时返回false
+    bool add_conn(int connfd, const sockaddr_in &addr);
+    // 连接已关闭且定时器已移除时把对象放回slab。连接交给工作线程期间不会被关闭，
+    // 对象只在reactor线程中、工作线程交还连接之后释放，不会与工作线程同时访问。
+    // 读写缓冲区同时还给缓冲池；重复调用时什么也不做
+    void release_conn(http_conn *user);
+    // 给SO_REUSEPORT监听组挂上一段cBPF程序，按收包的CPU选出同核的reactor
+    bool attach_cpu_steering();
+    // 连接进入kind对应的阶段，按该阶段的超时时间重新计时
+    void refresh_timer(int sockfd, int kind);
+    void close_timer(int sockfd);  // 关闭连接并移除其定时器
+    // 读到完整请求的连接先攒起来，本轮事件都处理完后由flush_tasks()一次交给线程池。
+    // 连接在攒起来之前已被后端标记为忙碌，之后超时或出错都只记下要关闭，交还之后才真正关闭，
+    // 因此攒下的连接不会在投递之前被关闭，fd也不会被新连接复用
+    void queue_task(int sockfd) {
+        m_ready.push_back(conn(sockfd));
+    }
+    void flush_tasks();
+    // 线程池的队列都满，回复503并关闭连接
+    virtual void reject(int sockfd);
+    void deal_signal();            // 读取signalfd中的信号
+    void deal_timer();             // timerfd到期，处理超时的连接
+    void deal_wakeup();            // 清空唤醒用的eventfd
+    // 每轮事件循环结束时调用：按最近的超时时间设置timerfd，并定期输出建连速率
+    void after_loop();
+    void log_pool_stats();  // 输出线程池的队列和延迟统计
+
+    // 每轮事件循环只取一次当前时间(CLOCK_MONOTONIC，毫秒)，供定时器使用
+    void update_time() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        m_now = (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    }
+
+private:
+    static void *worker(void *arg);
+
+protected:
+    int m_id;                       // reactor编号
+    int m_cpu;                      // 绑定的CPU，不绑核时为-1
+    const server_config &m_cfg;     // 启动参数
+    conn_table *m_conns;            // fd到连接对象的映射，本reactor只访问自己accept的fd
+    conn_slab m_slab;               // 本reactor的连接对象
+    threadpool<http_conn> *m_pool;  // 工作线程池，所有reactor共享
+
+    int m_listenfd;               // 本reactor独占的监听socket
+    int m_timerfd;                // 到期时间设为定时器链表中最早的超时时间
+    int m_sigfd;                  // signalfd，只有0号reactor有，其余为-1
+    int m_wakefd;                 // eventfd，其他线程通过它唤醒事件循环
+    std::atomic<bool> m_stop;     // 是否退出事件循环
+
+    std::vector<http_conn *> m_ready;  // 本轮等待交给线程池的连接
+
+    timer_queue *m_timers;       // 本reactor的定时器容器
+    long long m_now;             // 本轮事件循环的当前时间，毫秒
+    long long m_timer_armed;     // timerfd当前设置的到期时间，0表示未设置
+
+    // 建连速率统计
+    unsigned long long m_accept_count;       // 累计接受的连接数
+    unsigned long long m_last_accept_count;  // 上次统计时的累计连接数
+    long long m_last_stat_time;              // 上次统计的时间
+    // 绑核时统计新连接的数据包是否由本reactor所在的CPU接收(SO_INCOMING_CPU)
+    unsigned long long m_local_accept_count;
+    unsigned long long m_last_local_accept_count;
+    // 上次统计时线程池的排队和执行时间分布，与本次相减得到这段时间的分位数，只有0号reactor使用
+    histogram_snapshot m_last_wait;
+    histogram_snapshot m_last_service;
+
+private:
+    pthread_t m_thread;  // 事件循环线程
+    bool m_started;      // 是否已在独立线程中运行
+};
+
+#endif
@@ -0,0 +1,164 @@
+#include "router.h"
+
+#include <string.h>
+
+router::node::~node() {
+    for (size_t i = 0; i < children.size(); ++i) {
+        delete children[i];
+    }
+    delete param;
+    delete wildcard;
+}
+
+router::router() : m_root(new node) {}
+
+router::~router() {
+    delete m_root;
+}
+
+bool router::add(unsigned methods, const char *pattern, body_handler *handler) {
+    if (methods == 0 || (methods >> ROUTER_METHODS) != 0 || pattern[0] != '/') {
+        return false;
+    }
+    int params = 0;
+    for (const char *q = pattern; *q != '\0'; ++q) {
+        params += *q == ':' || *q == '*';
+    }
+    if (params > ROUTER_MAX_PARAMS) {
+        return false;
+    }
+
+    node *n = m_root;
+    const char *p = pattern;
+    while (*p != '\0') {
+        if (*p == ':' || *p == '*') {
+            // 参数和通配只能占据完整的一段；通配一直到最后
+            const char *end = *p == ':' ? p + strcspn(p, "/") : p + strlen(p);
+            if (p[-1] != '/' || end == p + 1 || memchr(p + 1, ':', end - p - 1) ||
+                memchr(p + 1, '*', end - p - 1)) {
+                return false;
+            }
+            std::string name(p + 1, end);
+            node *&child = *p == ':' ? n->param : n->wildcard;
+            if (child == NULL) {
+                child = new node;
+                child->label = name;
+            } else if (child->label != name) {
+                return false;
+            }
+            n = child;
+            p = end;
+            continue;
+        }
+
+        // 静态的一段到下一个参数或者通配为止，先找首字节相同的子节点
+        const char *end = p + strcspn(p, ":*");
+        node *child = NULL;
+        for (size_t i = 0; i < n->children.size(); ++i) {
+            if (n->children[i]->label[0] == *p) {
+                child = n->children[i];
+                break;
+            }
+        }
+        if (child == NULL) {
+            child = new node;
+            child->label.assign(p, end);
+            n->children.push_back(child);
+            n = child;
+            p = end;
+            continue;
+        }
+        // 已有的节点比公共前缀长时从公共前缀处分成两段，后一段带走它原来的子节点和路由
+        size_t k = 0;
+        while (k < child->label.size() && p + k < end && child->label[k] == p[k]) {
+            ++k;
+        }
+        if (k < child->label.size()) {
+            node *tail = new node;
+            tail->label = child->label.substr(k);
+            tail->children.swap(child->children);
+            tail->param = child->param;
+            tail->wildcard = child->wildcard;
+            tail->methods = child->methods;
+            memcpy(tail->handlers, child->handlers, sizeof(tail->handlers));
+            child->label.resize(k);
+            child->children.push_back(tail);
+            child->param = child->wildcard = NULL;
+            child->methods = 0;
+            memset(child->handlers, 0, sizeof(child->handlers));
+        }
+        n = child;
+        p += k;
+    }
+
+    if (n->methods & methods) {
+        return false;
+    }
+    n->methods |= methods;
+    for (int m = 0; m < ROUTER_METHODS; ++m) {
+        if (methods & (1u << m)) {
+            n->handlers[m] = handler;
+        }
+    }
+    return true;
+}
+
+// 从节点n(它的标签已经匹配)开始匹配path[pos, len)，依次尝试静态子节点、参数和通配，失败时回溯
+const router::node *router::find(const node *n, const char *path, int pos, int len, unsigned bit,
+                                 route_param *params, int &count) {
+    if (pos == len && (n->methods & bit)) {
+        return n;
+    }
+    if (pos < len) {
+        for (size_t i = 0; i < n->children.size(); ++i) {
+            const node *c = n->children[i];
+            if (c->label[0] != path[pos]) {
+                continue;
+            }
+            int l = c->label.size();
+            if (len - pos >= l && memcmp(path + pos, c->label.data(), l) == 0) {
+                const node *r = find(c, path, pos + l, len, bit, params, count);
+                if (r != NULL) {
+                    return r;
+                }
+            }
+            break;  // 首字节相同的子节点只有一个
+        }
+        if (n->param != NULL) {
+            int end = pos;
+            while (end < len && path[end] != '/') {
+                ++end;
+            }
+            if (end > pos) {
+                route_param &rp = params[count++];
+                rp.name = n->param->label.c_str();
+                rp.value = pos;
+                rp.value_len = end - pos;
+                const node *r = find(n->param, path, end, len, bit, params, count);
+                if (r != NULL) {
+                    return r;
+                }
+                --count;
+            }
+        }
+    }
+    if (n->wildcard != NULL && (n->wildcard->methods & bit)) {
+        route_param &rp = params[count++];
+        rp.name = n->wildcard->label.c_str();
+        rp.value = pos;
+        rp.value_len = len - pos;
+        return n->wildcard;
+    }
+    return NULL;
+}
+
+bool router::match(int method, const char *path, int len, body_handler *&handler,
+                   route_param *params, int &param_count) const {
+    param_count = 0;
+    const node *n = find(m_root, path, 0, len, 1u << method, params, param_count);
+    if (n == NULL) {
+        return false;
+    }
+    handler = n->handlers[method];
+    return true;
+}
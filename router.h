@@ -0,0 +1,60 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+#include "body_handler.h"
+
+#define ROUTER_METHODS 8     // 请求方法的个数，与http_conn::METHOD一致
+#define ROUTER_MAX_PARAMS 4  // 一条路由最多捕获的参数个数
+
+// 路由捕获的一个参数，值不拷贝，只记下它在路径中的位置
+struct route_param {
+    const char *name;  // 参数名，指向路由表中保存的名字
+    uint16_t value;    // 值的偏移
+    uint16_t value_len;
+};
+
+// 按请求方法和路径选出处理者的基数树(radix tree)，公共前缀只保存一次，按字节比较。路由的写法：
+//   /health        静态路径，整段匹配
+//   /stats/:group  以:开头的一段匹配路径中的一段(到下一个/为止，不能为空)，捕获为参数group
+//   /*path         以*开头的只能在最后，匹配剩下的全部路径(可以为空)，捕获为参数path
+// 同一个位置上静态路径优先，其次是参数，最后是通配，匹配不下去时回溯：
+// /health和/*path并存时，/healthz仍然落到/*path上。
+// 启动时注册，之后只读，多个线程可以同时查找；查找时不分配内存
+class router {
+public:
+    router();
+    ~router();
+
+    // 为methods中的方法注册一条路由，methods是以1 << http_conn::METHOD为位的掩码；
+    // 处理者为空表示按静态文件处理。写法有误、参数过多、同一位置上的参数名不一致，
+    // 或者方法已经注册过时返回false
+    bool add(unsigned methods, const char *pattern, body_handler *handler);
+    // 查找路径path(长度len，不含查询字符串)上method的路由，找到时给出处理者和捕获的参数，
+    // 参数的偏移相对于path；params至少要有ROUTER_MAX_PARAMS个
+    bool match(int method, const char *path, int len, body_handler *&handler, route_param *params,
+               int &param_count) const;
+
+private:
+    struct node {
+        std::string label;             // 静态节点为压缩后的一段路径，参数和通配节点为参数名
+        std::vector<node *> children;  // 静态子节点，首字节各不相同
+        node *param = NULL;            // 参数子节点
+        node *wildcard = NULL;         // 通配子节点
+        unsigned methods = 0;          // 在这里结束的路由注册了哪些方法
+        body_handler *handlers[ROUTER_METHODS] = {};
+
+        ~node();
+    };
+
+    static const node *find(const node *n, const char *path, int pos, int len, unsigned bit,
+                            route_param *params, int &count);
+
+    node *m_root;  // 空标签的根节点
+};
+
+#endif
@@ -0,0 +1,217 @@
+// 连接对象布局的微基准测试：比较拆分前的http_conn(所有字段混在一起，600字节)和现在的布局
+// (128字节、两个缓存行的热数据，地址、url、文件名和stat等冷数据放在另一块内存)。
+// 两个结构体照搬了两种布局中字段的顺序和大小，只用于测量，不包含http_conn的代码。
+// 模拟reactor处理事件：按随机顺序访问N个连接，每次读写一个事件中用到的字段
+// (fd、状态机、读写下标、缓冲区指针、iovec和定时器)，输出每个事件的平均耗时(纳秒)，
+// 能打开硬件计数器时同时输出每个事件的cache miss和L1D读miss次数。
+#include <linux/perf_event.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#define EVENTS 4000000  // 每组测试处理的事件数
+
+// 拆分前的布局
+struct legacy_conn {
+    bool m_et;
+    int m_sockfd;
+    void *m_reactor;
+    void *m_timer;
+    const char *doc_root;
+    const char *strings[9];  // ok_200_title到error_500_form
+    sockaddr_in m_address;
+    char *m_readbuf;
+    int m_read_cap;
+    int m_read_idx;
+    int m_checked_idx;
+    int m_start_line;
+    char *m_url;
+    char *m_version;
+    int m_method;
+    char *m_host;
+    bool m_linger;
+    int m_content_length;
+    char m_real_file[200];
+    struct stat m_file_stat;
+    char *m_file_address;
+    char *m_write_buf;
+    int m_write_cap;
+    int m_write_idx;
+    struct iovec m_iv[2];
+    int m_iv_count;
+    int bytes_to_send;
+    int bytes_have_send;
+    int m_check_state;
+};
+
+// 现在的布局，冷数据单独分配
+struct cold_data {
+    sockaddr_in address;
+    char *url;
+    char *version;
+    char *host;
+    int method;
+    int content_length;
+    char real_file[200];
+    struct stat file_stat;
+};
+
+struct alignas(64) hot_conn {
+    int m_sockfd;
+    bool m_et;
+    bool m_linger;
+    int m_check_state;
+    int m_read_idx;
+    int m_checked_idx;
+    int m_start_line;
+    void *m_reactor;
+    void *m_timer;
+    char *m_readbuf;
+    char *m_write_buf;
+    int m_write_idx;
+    int bytes_to_send;
+    struct iovec m_iv[2];
+    char *m_file_address;
+    cold_data *m_cold;
+    int bytes_have_send;
+    int m_iv_count;
+    int m_read_cap;
+    int m_write_cap;
+};
+
+static_assert(sizeof(hot_conn) == 128, "hot_conn应为两个缓存行");
+
+static unsigned g_seed = 2463534242u;
+static volatile long g_sink;  // 保存touch的结果，防止访问被优化掉
+
+static unsigned rand_next() {  // xorshift，避免rand()的锁和开销
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return g_seed;
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 硬件计数器，打不开时(虚拟机、没有PMU、perf_event_paranoid限制)为-1
+static int open_counter(unsigned type, unsigned long long config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static long long read_counter(int fd) {
+    long long v = 0;
+    if (fd < 0 || read(fd, &v, sizeof(v)) != sizeof(v)) {
+        return -1;
+    }
+    return v;
+}
+
+static void print_counter(const char *name, long long v) {
+    if (v < 0) {
+        printf(" | %s n/a", name);
+    } else {
+        printf(" | %s %.2f", name, (double)v / EVENTS);
+    }
+}
+
+// 一个读事件加一次写回的字段访问
+template <typename C>
+static long touch(C *c) {
+    long sum = c->m_sockfd + c->m_et + (long)c->m_reactor + (long)c->m_timer;
+    c->m_read_idx += 1;
+    c->m_checked_idx = c->m_read_idx;
+    c->m_start_line = c->m_checked_idx;
+    c->m_check_state ^= 1;
+    sum += (long)c->m_readbuf + (long)c->m_write_buf;
+    c->m_write_idx = c->m_read_idx & 1023;
+    c->bytes_to_send = c->m_write_idx;
+    c->bytes_have_send += c->bytes_to_send;
+    c->m_iv[0].iov_len = c->m_write_idx;
+    c->m_iv_count = 1;
+    sum += (long)c->m_file_address + c->m_linger;
+    return sum;
+}
+
+template <typename C>
+static void run(const char *name, std::vector<C *> &conns) {
+    int n = conns.size();
+    std::vector<int> order(EVENTS);
+    for (int i = 0; i < EVENTS; ++i) {
+        order[i] = rand_next() % n;
+    }
+    int misses = open_counter(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES);
+    int l1d = open_counter(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D |
+                                                   (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                                   (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    for (int fd : {misses, l1d}) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+    long sum = 0;
+    double start = now_ns();
+    for (int i = 0; i < EVENTS; ++i) {
+        sum += touch(conns[order[i]]);
+    }
+    double elapsed = now_ns() - start;
+    for (int fd : {misses, l1d}) {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        }
+    }
+    printf("%-6s | %6d | %4zu | %.1f", name, n, sizeof(C), elapsed / EVENTS);
+    print_counter("cache-misses", read_counter(misses));
+    print_counter("L1D-misses", read_counter(l1d));
+    printf("\n");
+    g_sink = sum;
+    for (int fd : {misses, l1d}) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+}
+
+int main() {
+    printf("layout | conns | size | ns/event\n");
+    int counts[] = {1000, 10000, 100000};
+    for (int n : counts) {
+        // 与conn_slab一样，连接对象成块连续分配
+        std::vector<legacy_conn> legacy(n);
+        std::vector<hot_conn> hot(n);
+        std::vector<cold_data> cold(n);
+        std::vector<legacy_conn *> lp(n);
+        std::vector<hot_conn *> hp(n);
+        for (int i = 0; i < n; ++i) {
+            memset(&legacy[i], 0, sizeof(legacy_conn));
+            memset(&hot[i], 0, sizeof(hot_conn));
+            hot[i].m_cold = &cold[i];
+            lp[i] = &legacy[i];
+            hp[i] = &hot[i];
+        }
+        run("legacy", lp);
+        run("hot", hp);
+    }
+    return 0;
+}
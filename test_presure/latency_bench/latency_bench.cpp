@@ -0,0 +1,155 @@
+// 请求延迟测试：开N个保持连接的客户端线程，每个线程串行地发送请求、收完整个响应后再发下一个，
+// 持续指定的秒数，统计每个请求从发出到收完响应的时间，输出每秒请求数和p50/p90/p99/p999延迟。
+// 与webbench不同，每个连接上同时只有一个请求，测出的是服务器处理一个请求的往返延迟。
+// 指定流水线深度D时，每个连接一次发出D个请求(HTTP/1.1流水线)，收完D个响应后再发下一批，
+// 这一批中每个请求的延迟都记为整批的往返时间
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+struct client {
+    pthread_t tid;
+    std::vector<double> lat;  // 每个请求的延迟，微秒
+    int errors;
+};
+
+static struct sockaddr_in g_addr;
+static std::vector<char> g_request;  // 一批请求，流水线深度为1时只有一个
+static int g_depth;
+static double g_deadline;
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int connect_server() {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&g_addr, sizeof(g_addr)) < 0) {
+        close(fd);
+        return -1;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+// 收完一个响应：先收到空行，再按Content-Length收完响应体，多收到的数据留在buf中。失败返回false
+static bool read_response(int fd, std::vector<char> &buf, size_t &len) {
+    size_t body = 0, need = 0;
+    while (true) {
+        if (need == 0) {
+            char *end = (char *)memmem(buf.data(), len, "\r\n\r\n", 4);
+            if (end != NULL) {
+                *end = '\0';
+                char *cl = strcasestr(buf.data(), "Content-Length:");
+                body = cl != NULL ? strtoul(cl + 15, NULL, 10) : 0;
+                need = end - buf.data() + 4 + body;
+            }
+        }
+        if (need > 0 && len >= need) {
+            memmove(buf.data(), buf.data() + need, len - need);
+            len -= need;
+            return true;
+        }
+        if (buf.size() - len < 65536) {
+            buf.resize(buf.size() * 2);
+        }
+        ssize_t n = recv(fd, buf.data() + len, buf.size() - len, 0);
+        if (n <= 0) {
+            return false;
+        }
+        len += n;
+    }
+}
+
+static void *run(void *arg) {
+    client *c = (client *)arg;
+    std::vector<char> buf(1 << 17);
+    size_t len = 0;
+    int fd = connect_server();
+    while (fd >= 0 && now_sec() < g_deadline) {
+        double t0 = now_sec();
+        bool ok = send(fd, g_request.data(), g_request.size(), 0) == (ssize_t)g_request.size();
+        for (int i = 0; ok && i < g_depth; ++i) {
+            ok = read_response(fd, buf, len);
+        }
+        if (!ok) {
+            // 连接被关闭(例如服务器拒绝了请求)，重新连接
+            ++c->errors;
+            close(fd);
+            len = 0;
+            fd = connect_server();
+            continue;
+        }
+        c->lat.insert(c->lat.end(), g_depth, (now_sec() - t0) * 1e6);
+    }
+    if (fd >= 0) {
+        close(fd);
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    if (argc < 3) {
+        printf("usage: %s host port [path] [connections] [seconds] [pipeline depth]\n", argv[0]);
+        return 1;
+    }
+    const char *path = argc > 3 ? argv[3] : "/index.html";
+    int conns = argc > 4 ? atoi(argv[4]) : 1;
+    int seconds = argc > 5 ? atoi(argv[5]) : 5;
+    g_depth = argc > 6 ? atoi(argv[6]) : 1;
+
+    struct hostent *host = gethostbyname(argv[1]);
+    if (host == NULL) {
+        printf("unknown host %s\n", argv[1]);
+        return 1;
+    }
+    memset(&g_addr, 0, sizeof(g_addr));
+    g_addr.sin_family = AF_INET;
+    g_addr.sin_port = htons(atoi(argv[2]));
+    memcpy(&g_addr.sin_addr, host->h_addr, sizeof(g_addr.sin_addr));
+    char request[1024];
+    int request_len = snprintf(request, sizeof(request),
+                               "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: keep-alive\r\n\r\n",
+                               path, argv[1]);
+    for (int i = 0; i < g_depth; ++i) {
+        g_request.insert(g_request.end(), request, request + request_len);
+    }
+
+    std::vector<client> clients(conns);
+    g_deadline = now_sec() + seconds;
+    for (int i = 0; i < conns; ++i) {
+        clients[i].errors = 0;
+        pthread_create(&clients[i].tid, NULL, run, &clients[i]);
+    }
+    std::vector<double> all;
+    int errors = 0;
+    for (int i = 0; i < conns; ++i) {
+        pthread_join(clients[i].tid, NULL);
+        all.insert(all.end(), clients[i].lat.begin(), clients[i].lat.end());
+        errors += clients[i].errors;
+    }
+    if (all.empty()) {
+        printf("no response, errors %d\n", errors);
+        return 1;
+    }
+    std::sort(all.begin(), all.end());
+    size_t n = all.size();
+    printf("requests %zu, %.0f req/s, errors %d\n", n, n / (double)seconds, errors);
+    printf("p50 %.1fus p90 %.1fus p99 %.1fus p999 %.1fus\n", all[n / 2], all[n * 90 / 100],
+           all[n * 99 / 100], all[n * 999 / 1000]);
+    return 0;
+}
@@ -0,0 +1,256 @@
+// 请求头解析的微基准测试：比较原来的逐字节parse_line加strncasecmp逐个比较字段名，
+// 和现在用char_scan按16/32字节查找行结束符和冒号、把每个头部记入索引并用完美哈希识别字段名的做法。
+// 语料是浏览器发出的真实请求(默认读取仓库根目录的get报文请求.txt，请求之间以空行分隔，换行转为\r\n)，
+// 另外把第一个请求加上一个1KB的Cookie，模拟带大Cookie的请求。
+// 每次解析前把请求拷贝到缓冲区(解析会把\r\n改写成'\0')，两种做法都包含这次拷贝。
+// 输出每种实现解析每个请求的平均耗时(纳秒)和吞吐(MB/s)，取5轮中最快的一轮
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+
+#include "char_scan.h"
+#include "http_header.h"
+
+#define ROUNDS 100000  // 每轮每个请求解析的次数
+#define REPEAT 5        // 每种实现测试的轮数，取最快的一轮，减少其他进程的干扰
+
+enum LINE_STATUS { LINE_OK = 0, LINE_BAD, LINE_OPEN };
+
+struct request {
+    char buf[8192];
+    int read_idx;
+    int checked_idx;
+    int start_line;
+    bool linger;
+    long content_length;
+    char *host;
+    int header_count;
+    int8_t known[HDR_COUNT];
+    header_field headers[32];
+};
+
+static volatile long g_sink;  // 保存解析结果，防止被优化掉
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// 原来的parse_line：逐字节查找\r和\n
+static LINE_STATUS legacy_parse_line(request *r) {
+    for (; r->checked_idx < r->read_idx; ++r->checked_idx) {
+        char ch = r->buf[r->checked_idx];
+        if (ch == '\r') {
+            if (r->checked_idx + 1 == r->read_idx) {
+                return LINE_OPEN;
+            } else if (r->buf[r->checked_idx + 1] == '\n') {
+                r->buf[r->checked_idx++] = '\0';
+                r->buf[r->checked_idx++] = '\0';
+                return LINE_OK;
+            }
+            return LINE_BAD;
+        } else if (ch == '\n') {
+            if (r->checked_idx > 1 && r->buf[r->checked_idx - 1] == '\r') {
+                r->buf[r->checked_idx - 1] = '\0';
+                r->buf[r->checked_idx++] = '\0';
+                return LINE_OK;
+            }
+            return LINE_BAD;
+        }
+    }
+    return LINE_OPEN;
+}
+
+// 原来的parse_headers：依次与每个已知字段名比较
+static void legacy_parse_header(request *r, char *text) {
+    if (strncasecmp(text, "Connection:", 11) == 0) {
+        text += 11;
+        text += strspn(text, " \t");
+        if (strcasecmp(text, "keep-alive") == 0) {
+            r->linger = true;
+        }
+    } else if (strncasecmp(text, "Content-Length:", 15) == 0) {
+        text += 15;
+        text += strspn(text, " \t");
+        r->content_length = atol(text);
+    } else if (strncasecmp(text, "Host:", 5) == 0) {
+        text += 5;
+        text += strspn(text, " \t");
+        r->host = text;
+    }
+}
+
+// 现在的parse_line，与http_conn::parse_line相同
+static LINE_STATUS scan_parse_line(request *r) {
+    const char *end = r->buf + r->read_idx;
+    const char *hit = char_scan::find_eol(r->buf + r->checked_idx, end);
+    r->checked_idx = hit - r->buf;
+    if (hit == end) {
+        return LINE_OPEN;
+    }
+    if (*hit == '\r') {
+        if (r->checked_idx + 1 == r->read_idx) {
+            return LINE_OPEN;
+        } else if (r->buf[r->checked_idx + 1] == '\n') {
+            r->buf[r->checked_idx++] = '\0';
+            r->buf[r->checked_idx++] = '\0';
+            return LINE_OK;
+        }
+        return LINE_BAD;
+    }
+    if (r->checked_idx > 1 && r->buf[r->checked_idx - 1] == '\r') {
+        r->buf[r->checked_idx - 1] = '\0';
+        r->buf[r->checked_idx++] = '\0';
+        return LINE_OK;
+    }
+    return LINE_BAD;
+}
+
+// 现在的parse_headers：找到冒号，记入索引，用完美哈希识别字段名，与http_conn::parse_headers相同
+static void scan_parse_header(request *r, char *text) {
+    char *line_end = r->buf + r->checked_idx - 2;
+    char *colon = (char *)char_scan::find_char(text, line_end, ':');
+    if (colon == line_end || colon == text || r->header_count == 32) {
+        return;
+    }
+    char *value = colon + 1;
+    value += strspn(value, " \t");
+    char *value_end = line_end;
+    while (value_end > value && (value_end[-1] == ' ' || value_end[-1] == '\t')) {
+        --value_end;
+    }
+    int idx = r->header_count++;
+    header_field &f = r->headers[idx];
+    f.name = text - r->buf;
+    f.name_len = colon - text;
+    f.value = value - r->buf;
+    f.value_len = value_end - value;
+    HEADER h = lookup_header(text, f.name_len);
+    if (h == HDR_UNKNOWN) {
+        return;
+    }
+    if (r->known[h] < 0) {
+        r->known[h] = idx;
+    }
+    if (h == HDR_CONNECTION) {
+        if (f.value_len == 10 && strncasecmp(value, "keep-alive", 10) == 0) {
+            r->linger = true;
+        }
+    } else if (h == HDR_CONTENT_LENGTH) {
+        r->content_length = atol(value);
+    } else if (h == HDR_HOST) {
+        r->host = value;
+    }
+}
+
+// 解析一个请求的请求行和全部头部，返回解析出的行数
+template <LINE_STATUS (*parse_line)(request *), void (*parse_header)(request *, char *)>
+static int parse(request *r, const std::string &raw) {
+    memcpy(r->buf, raw.data(), raw.size());
+    r->read_idx = raw.size();
+    r->checked_idx = r->start_line = 0;
+    r->linger = false;
+    r->content_length = 0;
+    r->host = NULL;
+    r->header_count = 0;
+    memset(r->known, -1, sizeof(r->known));
+    int lines = 0;
+    while (parse_line(r) == LINE_OK) {
+        char *text = r->buf + r->start_line;
+        r->start_line = r->checked_idx;
+        if (lines++ > 0 && text[0] != '\0') {
+            parse_header(r, text);
+        }
+    }
+    return lines;
+}
+
+template <LINE_STATUS (*parse_line)(request *), void (*parse_header)(request *, char *)>
+static void run(const char *name, const std::vector<std::string> &corpus) {
+    static request r;
+    size_t bytes = 0;
+    long sum = 0;
+    double best = 0;
+    for (int k = 0; k < REPEAT; ++k) {
+        bytes = 0;
+        double start = now_ns();
+        for (int i = 0; i < ROUNDS; ++i) {
+            for (size_t j = 0; j < corpus.size(); ++j) {
+                sum += parse<parse_line, parse_header>(&r, corpus[j]);
+                sum += r.linger + r.content_length + (r.host != NULL);
+                bytes += corpus[j].size();
+            }
+        }
+        double elapsed = now_ns() - start;
+        if (k == 0 || elapsed < best) {
+            best = elapsed;
+        }
+    }
+    g_sink = sum;
+    printf("%-8s | %8.1f | %6.0f\n", name, best / ROUNDS / corpus.size(), bytes / best * 1e3);
+}
+
+// 读入语料，请求之间以空行分隔，换行统一成\r\n
+static std::vector<std::string> load(const char *path) {
+    std::vector<std::string> corpus;
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        perror(path);
+        exit(1);
+    }
+    std::string cur;
+    char line[8192];
+    while (fgets(line, sizeof(line), fp) != NULL) {
+        size_t n = strcspn(line, "\r\n");
+        line[n] = '\0';
+        if (n == 0) {
+            if (!cur.empty()) {
+                corpus.push_back(cur + "\r\n");
+                cur.clear();
+            }
+            continue;
+        }
+        cur += line;
+        cur += "\r\n";
+    }
+    if (!cur.empty()) {
+        corpus.push_back(cur + "\r\n");
+    }
+    fclose(fp);
+    return corpus;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<std::string> corpus = load(argc > 1 ? argv[1] : "../../get报文请求.txt");
+    if (corpus.empty()) {
+        printf("empty corpus\n");
+        return 1;
+    }
+    // 带1KB Cookie的请求：在第一个请求的空行之前再加一个Cookie头
+    std::string big = corpus[0];
+    big.insert(big.size() - 2, "Cookie: session=" + std::string(1024, 'x') + "\r\n");
+    corpus.push_back(big);
+
+    size_t total = 0;
+    for (size_t i = 0; i < corpus.size(); ++i) {
+        total += corpus[i].size();
+    }
+    printf("%zu requests, %zu bytes on average\n", corpus.size(), total / corpus.size());
+    printf("impl     | ns/req   | MB/s\n");
+    run<legacy_parse_line, legacy_parse_header>("legacy", corpus);
+    char_scan::LEVEL levels[] = {char_scan::SCALAR, char_scan::SSE42, char_scan::AVX2};
+    for (char_scan::LEVEL l : levels) {
+        if (char_scan::select(l)) {
+            run<scan_parse_line, scan_parse_header>(char_scan::level_name(l), corpus);
+        } else {
+            printf("%-8s | not supported\n", char_scan::level_name(l));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,155 @@
+// 线程池的争用基准测试：比较原来的单锁线程池(一把locker + sem + std::list)和现在的工作窃取线程池
+// 若干个投递线程(模拟reactor)同时append任务，8个工作线程执行，统计每秒完成的任务数。
+// 任务本身只做一段可调长度的空循环，任务越短，队列本身的开销和锁争用占比越大。
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <atomic>
+#include <iostream>
+#include <list>
+#include <vector>
+
+#include "../../locker.h"
+#include "../../threadpool.h"
+
+// 原来的线程池实现，保留在这里作对比。工作线程是脱离的且没有退出机制，因此只创建一次、不析构
+template <typename T>
+class locked_pool {
+private:
+    std::list<T *> m_workqueue;
+    int m_max_requests;
+    locker m_queuelocker;
+    sem m_queuestat;
+
+public:
+    locked_pool(int thread_num = 8, int max_requests = 10000) : m_max_requests(max_requests) {
+        for (int i = 0; i < thread_num; ++i) {
+            pthread_t tid;
+            if (pthread_create(&tid, NULL, worker, this) != 0 || pthread_detach(tid) != 0) {
+                throw std::exception();
+            }
+        }
+    }
+
+    bool append(T *task) {
+        m_queuelocker.lock();
+        if (m_workqueue.size() >= (size_t)m_max_requests) {
+            m_queuelocker.unlock();
+            return false;
+        }
+        m_workqueue.push_back(task);
+        m_queuelocker.unlock();
+        m_queuestat.post();
+        return true;
+    }
+
+private:
+    static void *worker(void *arg) {
+        ((locked_pool *)arg)->run();
+        return NULL;
+    }
+
+    void run() {
+        while (true) {
+            m_queuestat.wait();
+            m_queuelocker.lock();
+            if (m_workqueue.empty()) {
+                m_queuelocker.unlock();
+                continue;
+            }
+            T *task = m_workqueue.front();
+            m_workqueue.pop_front();
+            m_queuelocker.unlock();
+            task->process();
+        }
+    }
+};
+
+static std::atomic<long> g_done(0);  // 已完成的任务数
+
+struct task {
+    int work;  // 空循环次数
+    void process() {
+        for (volatile int i = 0; i < work; ++i) {
+        }
+        g_done.fetch_add(1, std::memory_order_release);
+    }
+};
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+template <typename P>
+struct producer_arg {
+    P *pool;
+    task *t;
+    long count;
+};
+
+template <typename P>
+static void *produce(void *arg) {
+    producer_arg<P> *a = (producer_arg<P> *)arg;
+    for (long i = 0; i < a->count; ++i) {
+        // 队列满时让出CPU再试，和reactor遇到满队列时的处理无关，只为把任务全部投递出去
+        while (!a->pool->append(a->t)) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+// 返回每秒完成的任务数(百万)
+template <typename P>
+static double bench(P *pool, int producers, long per_producer, int work) {
+    std::vector<pthread_t> tids(producers);
+    std::vector<producer_arg<P>> args(producers);
+    task t = {work};
+    long total = per_producer * producers;
+    long base = g_done.load();
+
+    double start = now_sec();
+    for (int i = 0; i < producers; ++i) {
+        args[i].pool = pool;
+        args[i].t = &t;
+        args[i].count = per_producer;
+        pthread_create(&tids[i], NULL, produce<P>, &args[i]);
+    }
+    for (int i = 0; i < producers; ++i) {
+        pthread_join(tids[i], NULL);
+    }
+    while (g_done.load() - base < total) {
+        sched_yield();
+    }
+    return total / (now_sec() - start) / 1e6;
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);
+    long per_producer = argc > 1 ? atol(argv[1]) : 500000;
+    int producer_counts[] = {1, 2, 4};
+    int works[] = {0, 200};
+
+    // 线程池构造时会逐个打印创建线程的信息，这里不需要
+    std::cout.setstate(std::ios::failbit);
+    locked_pool<task> *locked = new locked_pool<task>;
+    threadpool<task> *stealing = new threadpool<task>;
+    std::cout.clear();
+
+    printf("%-10s %9s %6s %12s\n", "pool", "producers", "work", "Mtasks/s");
+    for (size_t w = 0; w < sizeof(works) / sizeof(works[0]); ++w) {
+        for (size_t p = 0; p < sizeof(producer_counts) / sizeof(producer_counts[0]); ++p) {
+            int n = producer_counts[p];
+            printf("%-10s %9d %6d %12.2f\n", "locked", n, works[w],
+                   bench(locked, n, per_producer, works[w]));
+            printf("%-10s %9d %6d %12.2f\n", "stealing", n, works[w],
+                   bench(stealing, n, per_producer, works[w]));
+        }
+    }
+    delete stealing;
+    return 0;
+}
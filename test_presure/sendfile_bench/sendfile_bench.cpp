@@ -0,0 +1,185 @@
+// 响应体发送方式的基准测试：比较映射文件后writev(原来的做法)、sendfile和经管道splice三种方式
+// 在回环TCP连接上反复发送"响应头+文件"，接收线程用MSG_TRUNC直接丢弃数据，尽量不计接收方的拷贝。
+// 输出每种方式、每种文件大小的吞吐(MB/s)、发送线程每GB消耗的CPU时间(秒)和每个响应的平均耗时(微秒)。
+// 文件在测试前读过一遍，都在页缓存中；writev使用的映射也预先访问过，与服务器中缓存的映射一样不再缺页
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TOTAL_BYTES (1LL << 30)  // 每组测试发送的总字节数
+#define PIPE_SIZE (256 * 1024)
+
+static const char g_header[] =
+    "HTTP/1.1 200 OK\r\nContent-Length: 0000000000\r\nContent-Type:text/html\r\n"
+    "Connection: keep-alive\r\n\r\n";
+
+static double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double thread_cpu_sec() {
+    struct rusage ru;
+    getrusage(RUSAGE_THREAD, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec +
+           ru.ru_stime.tv_usec / 1e6;
+}
+
+static void *drain(void *arg) {
+    int fd = *(int *)arg;
+    static char buf[65536];
+    while (recv(fd, buf, sizeof(buf), MSG_TRUNC) > 0) {
+    }
+    return NULL;
+}
+
+// 建立一对回环TCP连接，返回发送端，接收端交给丢弃线程
+static int connect_pair(pthread_t *tid, int *rfd) {
+    int lfd = socket(AF_INET, SOCK_STREAM, 0);
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(lfd, 1) < 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &len) < 0) {
+        perror("listen");
+        exit(1);
+    }
+    int sfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(sfd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        exit(1);
+    }
+    *rfd = accept(lfd, NULL, NULL);
+    close(lfd);
+    pthread_create(tid, NULL, drain, rfd);
+    return sfd;
+}
+
+enum MODE { MODE_WRITEV = 0, MODE_SENDFILE, MODE_SPLICE };
+static const char *g_mode_name[] = {"writev", "sendfile", "splice"};
+
+// 发送一个完整的响应，套接字是阻塞的，每个调用都会发完为止或者返回已发送的部分
+static void send_response(int mode, int sfd, int file_fd, char *map, size_t size, int *pipefd) {
+    size_t hlen = sizeof(g_header) - 1;
+    if (mode == MODE_WRITEV) {
+        struct iovec iov[2] = {{(void *)g_header, hlen}, {map, size}};
+        size_t left = hlen + size;
+        while (left > 0) {
+            ssize_t n = writev(sfd, iov, 2);
+            if (n <= 0) {
+                exit(1);
+            }
+            left -= n;
+            // 与http_conn::advance_write一样调整两个数据块
+            if ((size_t)n >= iov[0].iov_len) {
+                n -= iov[0].iov_len;
+                iov[0].iov_len = 0;
+                iov[1].iov_base = (char *)iov[1].iov_base + n;
+                iov[1].iov_len -= n;
+            } else {
+                iov[0].iov_base = (char *)iov[0].iov_base + n;
+                iov[0].iov_len -= n;
+            }
+        }
+        return;
+    }
+    send(sfd, g_header, hlen, MSG_MORE);
+    off_t off = 0;
+    while ((size_t)off < size) {
+        if (mode == MODE_SENDFILE) {
+            if (sendfile(sfd, file_fd, &off, size - off) <= 0) {
+                exit(1);
+            }
+        } else {
+            size_t chunk = size - off < PIPE_SIZE ? size - off : PIPE_SIZE;
+            ssize_t in = splice(file_fd, &off, pipefd[1], NULL, chunk, SPLICE_F_MOVE);
+            if (in <= 0) {
+                exit(1);
+            }
+            while (in > 0) {
+                ssize_t out = splice(pipefd[0], NULL, sfd, NULL, in,
+                                     SPLICE_F_MOVE | ((size_t)off < size ? SPLICE_F_MORE : 0));
+                if (out <= 0) {
+                    exit(1);
+                }
+                in -= out;
+            }
+        }
+    }
+}
+
+static void run(int mode, const char *path, size_t size) {
+    int file_fd = open(path, O_RDONLY);
+    char *map = (char *)mmap(NULL, size, PROT_READ, MAP_PRIVATE, file_fd, 0);
+    volatile char sum = 0;
+    for (size_t i = 0; i < size; i += 4096) {
+        sum += map[i];
+    }
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    fcntl(pipefd[1], F_SETPIPE_SZ, PIPE_SIZE);
+
+    pthread_t tid;
+    int rfd;
+    int sfd = connect_pair(&tid, &rfd);
+    long long rounds = TOTAL_BYTES / (long long)size;
+    double t0 = now_sec(), c0 = thread_cpu_sec();
+    for (long long i = 0; i < rounds; ++i) {
+        send_response(mode, sfd, file_fd, map, size, pipefd);
+    }
+    double t1 = now_sec(), c1 = thread_cpu_sec();
+    shutdown(sfd, SHUT_WR);
+    pthread_join(tid, NULL);
+    close(sfd);
+    close(rfd);
+
+    double gb = (double)rounds * size / (1 << 30);
+    printf("%-8s | %9zu | %8.0f | %6.3f | %8.2f\n", g_mode_name[mode], size,
+           gb * 1024 / (t1 - t0), (c1 - c0) / gb, (t1 - t0) * 1e6 / rounds);
+    munmap(map, size);
+    close(file_fd);
+    close(pipefd[0]);
+    close(pipefd[1]);
+}
+
+int main(int argc, char *argv[]) {
+    const char *path = argc > 1 ? argv[1] : "/tmp/sendfile_bench.dat";
+    size_t sizes[] = {4096, 16384, 65536, 1 << 20, 64 << 20};
+    size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    char block[65536];
+    memset(block, 'x', sizeof(block));
+    for (size_t n = 0; n < max; n += sizeof(block)) {
+        if (write(fd, block, sizeof(block)) != (ssize_t)sizeof(block)) {
+            perror("write");
+            return 1;
+        }
+    }
+    printf("mode     |     bytes |     MB/s | CPU s/GB | us/resp\n");
+    // 每种大小都发送文件开头的sizes[s]字节
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+        for (int mode = MODE_WRITEV; mode <= MODE_SPLICE; ++mode) {
+            run(mode, path, sizes[s]);
+        }
+    }
+    close(fd);
+    unlink(path);
+    return 0;
+}
@@ -0,0 +1,87 @@
+// 发送超时(--write-timeout)的测试：客户端把接收缓冲区设得很小，请求一个大文件后停止读取，
+// 服务器的发送很快就没有进展。等待一段时间后再把数据读完：服务器按时关闭了连接时，
+// 读到的只是关闭前已经在路上的那部分数据，随后是EOF或RST；没有关闭时会收到完整的响应体。
+// 服务器关闭了连接返回0，否则返回1
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+int main(int argc, char *argv[]) {
+    if (argc < 4) {
+        printf("usage: %s ip port path [等待毫秒数，默认3000] [接收缓冲区字节数，默认4096]\n", argv[0]);
+        return 2;
+    }
+    const char *path = argv[3];
+    int wait_ms = argc > 4 ? atoi(argv[4]) : 3000;
+    int rcvbuf = argc > 5 ? atoi(argv[5]) : 4096;
+
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    // 接收窗口在建连时就确定了，必须在connect之前设置
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(atoi(argv[2]));
+    inet_pton(AF_INET, argv[1], &addr.sin_addr);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("connect");
+        return 2;
+    }
+    char req[1024];
+    int len = snprintf(req, sizeof(req), "GET %s HTTP/1.1\r\nHost: %s\r\n\r\n", path, argv[1]);
+    if (send(fd, req, len, 0) != len) {
+        perror("send");
+        return 2;
+    }
+
+    // 停止读取，让服务器的发送停滞
+    usleep(wait_ms * 1000);
+
+    // 读到EOF或者出错为止；服务器没有关闭时读完声明的长度就结束，每次读取最多等5秒
+    struct timeval tv = {5, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    static char buf[65536];
+    long long total = 0, body_len = -1, header_len = 0;
+    const char *end = "EOF";
+    while (true) {
+        int n = recv(fd, buf, sizeof(buf), 0);
+        if (n == 0) {
+            break;
+        }
+        if (n < 0) {
+            end = errno == EAGAIN ? "timeout" : strerror(errno);
+            break;
+        }
+        if (total == 0) {
+            // 第一块中就有完整的响应头
+            buf[n < (int)sizeof(buf) ? n : n - 1] = '\0';
+            const char *cl = strcasestr(buf, "Content-Length:");
+            const char *hend = strstr(buf, "\r\n\r\n");
+            if (cl != NULL && hend != NULL) {
+                body_len = atoll(cl + 15);
+                header_len = hend + 4 - buf;
+            }
+        }
+        total += n;
+        if (body_len >= 0 && total - header_len >= body_len) {
+            end = "complete";
+            break;
+        }
+    }
+    close(fd);
+
+    long long body = total > header_len ? total - header_len : 0;
+    printf("received %lld of %lld body bytes, ended by %s\n", body, body_len, end);
+    if (body_len > 0 && body < body_len && strcmp(end, "timeout") != 0) {
+        printf("ok: server closed the stalled connection\n");
+        return 0;
+    }
+    printf("FAILED: server did not close the stalled connection\n");
+    return 1;
+}
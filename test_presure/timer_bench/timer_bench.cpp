@@ -0,0 +1,108 @@
+// 定时器容器的微基准测试：比较升序链表(sort_timer_lst)、分层时间轮(time_wheel)和时间堆(TimeHeap)
+// 模拟连接的生命周期：先为N个连接各插入一个定时器，再随机刷新其中的定时器(每次收发数据)，
+// 最后删除全部定时器(连接关闭)。时间由测试程序模拟，每16次操作前进1毫秒，超时时间固定为15秒。
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <vector>
+
+#include "../../heap_timer.h"
+#include "../../lst_timer.h"
+#include "../../time_wheel.h"
+
+#define TIMEOUT 15000  // 超时时间，毫秒
+
+static long long g_now = 1000000;  // 模拟的当前时间
+static unsigned g_seed = 2463534242u;
+
+static unsigned rand_next() {  // xorshift，避免rand()的锁和开销
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return g_seed;
+}
+
+static double now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void noop(http_conn *) {}
+
+struct result {
+    double insert;   // 每次插入的平均耗时，纳秒
+    double refresh;  // 每次刷新的平均耗时，纳秒
+    double cancel;   // 每次删除的平均耗时，纳秒
+};
+
+// 三种容器实现同一个接口
+static result bench_queue(timer_queue *q, int n, int refreshes) {
+    result r;
+    std::vector<util_timer *> timers(n);
+
+    double start = now_ns();
+    for (int i = 0; i < n; ++i) {
+        if ((i & 15) == 0) {
+            ++g_now;
+        }
+        util_timer *t = q->get_timer();
+        t->callback = noop;
+        t->user_data = NULL;
+        t->expire = g_now + TIMEOUT;
+        q->add_timer(t);
+        timers[i] = t;
+    }
+    r.insert = (now_ns() - start) / n;
+
+    start = now_ns();
+    for (int i = 0; i < refreshes; ++i) {
+        if ((i & 15) == 0) {
+            ++g_now;
+        }
+        util_timer *t = timers[rand_next() % n];
+        t->expire = g_now + TIMEOUT;
+        q->adjust_timer(t);
+    }
+    r.refresh = (now_ns() - start) / refreshes;
+
+    start = now_ns();
+    for (int i = 0; i < n; ++i) {
+        q->del_timer(timers[i]);
+    }
+    r.cancel = (now_ns() - start) / n;
+    return r;
+}
+
+static void print(const char *name, int n, const result &r) {
+    printf("%-6s %8d %12.1f %12.1f %12.1f\n", name, n, r.insert, r.refresh, r.cancel);
+}
+
+int main(int argc, char *argv[]) {
+    setvbuf(stdout, NULL, _IONBF, 0);  // 链表在100k时要跑十几秒，结果逐行输出
+    int sizes[] = {1000, 10000, 100000};
+    int refreshes = argc > 1 ? atoi(argv[1]) : 1000000;
+
+    printf("%-6s %8s %12s %12s %12s   (ns/op)\n", "queue", "timers", "insert", "refresh",
+           "cancel");
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+        int n = sizes[i];
+
+        // 链表的刷新是O(n)的，按规模减少刷新次数，否则要跑好几分钟
+        sort_timer_lst lst;
+        int lst_refreshes = refreshes;
+        if ((long long)lst_refreshes * n > 200000000LL) {
+            lst_refreshes = 200000000 / n;
+        }
+        print("list", n, bench_queue(&lst, n, lst_refreshes));
+
+        time_wheel wheel;
+        wheel.tick(g_now);
+        print("wheel", n, bench_queue(&wheel, n, refreshes));
+
+        TimeHeap heap(1024);
+        print("heap", n, bench_queue(&heap, n, refreshes));
+    }
+    return 0;
+}
@@ -2,126 +2,576 @@
 #define THREADPOOL_H
 
 #include <pthread.h>
+#include <time.h>
 
+#include <atomic>
 #include <iostream>
-#include <list>
+#include <vector>
 
+#include "cpu_affinity.h"
+#include "histogram.h"
 #include "locker.h"
+#include "mpmc_queue.h"
+
+// 线程池自动调整大小的参数
+#define POOL_ADJUST_INTERVAL 1000  // 每隔多少毫秒评估一次
+#define POOL_WAIT_HIGH 2000000     // 排队时间p99超过2毫秒且线程都很忙时扩容，纳秒
+#define POOL_WAIT_LOW 500000       // 排队时间p99低于0.5毫秒且线程大多空闲时才考虑缩容，纳秒
+#define POOL_UTIL_HIGH 0.6         // 线程忙碌时间的占比，高于它才扩容，否则排队不是因为线程不够
+#define POOL_UTIL_LOW 0.2          // 低于它才缩容
+#define POOL_SHRINK_ROUNDS 5       // 连续这么多次都满足缩容条件才减少一个线程，避免来回抖动
+
+// 工作线程一次从自己的队列最多取走多少个任务。只取队列中的一半，剩下的仍可被其他线程窃取
+#define POOL_POP_BATCH 8
 
 // 线程池类 T是任务类
+// 每个工作线程有自己的无锁任务队列，投递任务时轮流放入各个队列，不再让所有线程争抢同一把锁；
+// 自己的队列空了就随机挑一个别的队列窃取任务，都没有任务时在自己的futex上睡眠
+// 线程数在[min_threads, max_threads]之间，由一个监控线程根据排队时间和线程忙碌程度增减
 template <typename T>
 class threadpool {
 private:
-    // 线程的数量
-    int m_thread_num;
+    enum { WORKER_RUNNING = 0, WORKER_PARKED = 1 };
+
+    // 队列中保存任务和它入队的时间，出队时据此算出排队等待的时间
+    struct queued_task {
+        T *task;
+        uint64_t enqueue_ns;
+    };
+
+    // 工作线程的任务队列。投递者(reactor)是生产者，队列所属线程和窃取者都是消费者，
+    // 因此用定长的MPMC队列，投递任务时既不加锁也不分配链表结点
+    // 按缓存行对齐，相邻线程的状态不会互相干扰
+    struct alignas(64) worker_queue {
+        mpmc_queue<queued_task> *tasks;
+        std::atomic<int> state;        // 线程是否在睡眠，同时也是futex等待的地址
+        unsigned seed;                 // 选择窃取对象的随机数种子
+        int id;
+        bool started;                  // 线程是否已创建且尚未被回收，只有监控线程和构造、析构访问
+        pthread_t thread;
+        threadpool *pool;
+        // 本线程取到的任务的排队时间和执行时间(纳秒)，只有本线程写入
+        latency_histogram wait_hist;
+        latency_histogram service_hist;
+        std::atomic<uint64_t> busy_ns;  // 累计执行任务的时间，用于计算忙碌程度
+    };
 
-    // 线程池数组
-    pthread_t *m_threads;
+    // 线程数的上下限，为每个可能的线程都预先准备好队列
+    int m_min_threads;
+    int m_max_threads;
 
-    // 工作队列
-    std::list<T *> m_workqueue;
+    // 当前的线程数，编号小于它的队列才会被投递任务
+    std::atomic<int> m_thread_num;
 
-    // 工作队列最多允许等待请求数量
+    // 每个线程一个任务队列
+    worker_queue *m_queues;
+
+    // 工作队列最多允许等待请求数量，按最少的线程数平均分到每个队列上
     int m_max_requests;
 
-    // 互斥锁
-    locker m_queuelocker;
+    // 正在睡眠的线程数
+    std::atomic<int> m_idle;
+
+    // 自己的队列为空、正在别的队列上找任务的线程数
+    std::atomic<int> m_searching;
+
+    // 所有队列都满、投递失败的次数
+    std::atomic<unsigned long long> m_rejected;
+
+    // 扩容、缩容的次数
+    std::atomic<unsigned long long> m_grow_count;
+    std::atomic<unsigned long long> m_shrink_count;
 
-    // 信号量，用于判断是否有任务需要处理
-    sem m_queuestat;
+    // 监控线程，线程数固定时不创建
+    pthread_t m_monitor;
+    bool m_monitor_started;
+    std::atomic<int> m_monitor_wake;  // 监控线程定时等待的futex，析构时置1唤醒它
+    // 上次评估时的统计，与本次相减得到这段时间内的情况
+    histogram_snapshot m_last_wait;
+    uint64_t m_last_busy;
+    uint64_t m_last_adjust;
+    int m_calm_rounds;  // 连续满足缩容条件的次数
 
     // 是否结束线程
-    bool m_stop;
+    std::atomic<bool> m_stop;
+
+    // 绑定的CPU，第i个线程绑定在m_cpus[i % m_cpus.size()]上，为空时不绑核
+    std::vector<int> m_cpus;
 
 public:
-    threadpool(int thread_num = 8, int max_requests = 10000);
+    // max_threads为0或不大于thread_num时线程数固定为thread_num
+    // cpus非空时每个线程绑定在一个CPU上，它的队列也在该CPU的NUMA节点上分配
+    threadpool(int thread_num = 8, int max_requests = 10000, int max_threads = 0,
+               const std::vector<int> &cpus = std::vector<int>());
     ~threadpool();
+    // 所有队列都满时返回false，任务没有被接收，由调用者决定如何处理这个请求
     bool append(T *task);
+    // 批量投递count个任务：分成几段，每段用一次CAS放入一个线程的队列，每段最多唤醒一个线程
+    // 返回被接收的个数k，被接收的总是前k个，tasks[k..count)由调用者处理
+    // cpu为投递者所在的CPU，绑核时先放进同一个CPU上的线程的队列，不够再分给其他线程
+    int append_batch(T **tasks, int count, int cpu = -1);
+    // 排队等待处理的任务数，并发修改时是一个近似值
+    int size() const;
+    unsigned long long rejected() const {
+        return m_rejected.load(std::memory_order_relaxed);
+    }
+    // 合并所有线程的直方图，得到启动以来任务排队等待和执行所用时间的分布(纳秒)
+    void latency(histogram_snapshot &wait, histogram_snapshot &service) const;
+    // 当前线程数和上下限，以及启动以来扩容、缩容的次数
+    int thread_num() const {
+        return m_thread_num.load(std::memory_order_relaxed);
+    }
+    int min_threads() const {
+        return m_min_threads;
+    }
+    int max_threads() const {
+        return m_max_threads;
+    }
+    unsigned long long grow_count() const {
+        return m_grow_count.load(std::memory_order_relaxed);
+    }
+    unsigned long long shrink_count() const {
+        return m_shrink_count.load(std::memory_order_relaxed);
+    }
 
 private:
     // 因为所有的成员函数都会默认带一个this参数指向本类
     // 但是多线程的worker不允许多参数，故必须设为静态函数，保证能调用
     // 原理：静态成员函数是没有this指针的
     static void *worker(void *arg);
-    void run();
+    void run(int id);
+    static void *monitor(void *arg);
+    void adjust();
+    bool grow(int target);
+    void shrink();
+
+    static uint64_t now_ns() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    bool pop(worker_queue &q, queued_task &item);
+    bool steal(int id, queued_task &item);
+    bool park(int id, queued_task &item);
+    bool wake(int id);
+    void notify(int id, int n);
+    int push_chunk(int id, T **tasks, int count, uint64_t now, int n);
+    int worker_cpu(int id) const {
+        return m_cpus.empty() ? -1 : m_cpus[id % m_cpus.size()];
+    }
+    void shutdown();
 };
 
 template <typename T>
-threadpool<T>::threadpool(int thread_num, int max_requests)
-    : m_thread_num(thread_num), m_max_requests(max_requests), m_stop(false), m_threads(NULL) {
+threadpool<T>::threadpool(int thread_num, int max_requests, int max_threads,
+                          const std::vector<int> &cpus)
+    : m_min_threads(thread_num),
+      m_max_threads(max_threads > thread_num ? max_threads : thread_num),
+      m_thread_num(0),
+      m_queues(NULL),
+      m_max_requests(max_requests),
+      m_idle(0),
+      m_searching(0),
+      m_rejected(0),
+      m_grow_count(0),
+      m_shrink_count(0),
+      m_monitor_started(false),
+      m_monitor_wake(0),
+      m_last_busy(0),
+      m_last_adjust(0),
+      m_calm_rounds(0),
+      m_stop(false),
+      m_cpus(cpus) {
     if ((thread_num <= 0) | (max_requests <= 0)) {
         throw std::exception();
     }
-    m_threads = new pthread_t[m_thread_num];
-    // new创建失败
-    if (m_threads == nullptr) {
-        throw std::exception();
+    // 每个队列的容量向上取整到2的幂，线程最少时总容量也不小于max_requests
+    m_queues = new worker_queue[m_max_threads];
+    for (int i = 0; i < m_max_threads; ++i) {
+        worker_queue &q = m_queues[i];
+        // 队列的格子在构造时就被写入，在线程所在的CPU上构造，格子便分配在该CPU的本地节点
+        cpu_scope scope(worker_cpu(i));
+        q.tasks = new mpmc_queue<queued_task>((max_requests + thread_num - 1) / thread_num);
+        q.state = WORKER_RUNNING;
+        q.seed = 2463534242u * (i + 1);
+        q.id = i;
+        q.started = false;
+        q.pool = this;
+        q.busy_ns = 0;
     }
 
-    // 创建thread_num个线程，并设置线程脱离
+    // 创建thread_num个线程，析构时通知它们退出并等待结束
     for (int i = 0; i < thread_num; ++i) {
         std::cout << "正在创建第 " << i + 1 << "个线程" << std::endl;
-
-        // 由于静态函数无法访问非静态成员，故通过将this指针传递过去作为参数来访问
-        if (pthread_create(&m_threads[i], NULL, worker, this) != 0) {
-            delete[] m_threads;
+        if (!grow(i + 1)) {
+            shutdown();
             throw std::exception();
         }
+    }
 
-        if (pthread_detach(m_threads[i]) != 0) {
-            delete[] m_threads;
+    if (m_max_threads > m_min_threads) {
+        m_last_adjust = now_ns();
+        if (pthread_create(&m_monitor, NULL, monitor, this) != 0) {
+            shutdown();
             throw std::exception();
         }
+        m_monitor_started = true;
     }
 }
 
 template <typename T>
 threadpool<T>::~threadpool() {
-    delete[] m_threads;
-    m_stop = true;
+    shutdown();
+}
+
+// 通知所有线程退出并等待它们结束，队列中剩余的任务不再处理
+template <typename T>
+void threadpool<T>::shutdown() {
+    m_stop.store(true);
+    // 先停下监控线程，之后线程数不会再变化
+    if (m_monitor_started) {
+        m_monitor_wake.store(1);
+        futex_wake(&m_monitor_wake, 1);
+        pthread_join(m_monitor, NULL);
+        m_monitor_started = false;
+    }
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (int i = 0; i < m_max_threads; ++i) {
+        wake(i);
+    }
+    for (int i = 0; i < m_max_threads; ++i) {
+        if (m_queues[i].started) {
+            pthread_join(m_queues[i].thread, NULL);
+        }
+    }
+    for (int i = 0; i < m_max_threads; ++i) {
+        delete m_queues[i].tasks;
+    }
+    delete[] m_queues;
+    m_queues = NULL;
+}
+
+// 把线程数增加到target，新线程的编号接在现有线程之后
+template <typename T>
+bool threadpool<T>::grow(int target) {
+    for (int id = m_thread_num.load(); id < target; ++id) {
+        worker_queue &q = m_queues[id];
+        // 先让投递者看到这个队列再创建线程，线程启动前投递的任务留在队列里等它处理
+        m_thread_num.store(id + 1);
+        // 由于静态函数无法访问非静态成员，故把线程自己的队列传递过去，队列中保存着this指针
+        if (create_pinned_thread(&q.thread, worker_cpu(id), worker, &q) != 0) {
+            m_thread_num.store(id);
+            return false;
+        }
+        q.started = true;
+    }
+    return true;
+}
+
+// 减少编号最大的线程：它处理完手上的任务和自己队列中剩下的任务后退出，在这里等它结束
+template <typename T>
+void threadpool<T>::shrink() {
+    int id = m_thread_num.load() - 1;
+    m_thread_num.store(id);
+    // 与park()中的栅栏配对，它要么看到新的线程数，要么在这里被叫醒
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    wake(id);
+    pthread_join(m_queues[id].thread, NULL);
+    m_queues[id].started = false;
+}
+
+template <typename T>
+void *threadpool<T>::monitor(void *arg) {
+    threadpool *pool = (threadpool *)arg;
+    struct timespec interval = {POOL_ADJUST_INTERVAL / 1000, POOL_ADJUST_INTERVAL % 1000 * 1000000};
+    while (!pool->m_stop.load()) {
+        futex_wait(&pool->m_monitor_wake, 0, &interval);
+        if (pool->m_stop.load()) {
+            break;
+        }
+        pool->adjust();
+    }
+    return NULL;
+}
+
+// 根据上次评估以来的排队时间和线程忙碌程度调整线程数：
+// 排队久而线程又都很忙，说明线程不够，按当前线程数的1/4扩容；
+// 排队很短且线程大多空闲，连续多次后减少一个线程。排队久但线程并不忙时不扩容，多开线程也没有用
+template <typename T>
+void threadpool<T>::adjust() {
+    histogram_snapshot wait, service;
+    latency(wait, service);
+    histogram_snapshot wait_delta = wait;
+    wait_delta.subtract(m_last_wait);
+    m_last_wait = wait;
+
+    uint64_t busy = 0;
+    for (int i = 0; i < m_max_threads; ++i) {
+        busy += m_queues[i].busy_ns.load(std::memory_order_relaxed);
+    }
+    uint64_t now = now_ns();
+    int active = m_thread_num.load();
+    double util = (double)(busy - m_last_busy) / ((double)(now - m_last_adjust) * active);
+    m_last_busy = busy;
+    m_last_adjust = now;
+    uint64_t wait_p99 = wait_delta.percentile(0.99);
+
+    if (wait_p99 > POOL_WAIT_HIGH && util > POOL_UTIL_HIGH && active < m_max_threads) {
+        int target = active + (active / 4 > 1 ? active / 4 : 1);
+        if (target > m_max_threads) {
+            target = m_max_threads;
+        }
+        grow(target);
+        m_grow_count.fetch_add(1, std::memory_order_relaxed);
+        m_calm_rounds = 0;
+    } else if (wait_p99 < POOL_WAIT_LOW && util < POOL_UTIL_LOW && active > m_min_threads) {
+        if (++m_calm_rounds >= POOL_SHRINK_ROUNDS) {
+            shrink();
+            m_shrink_count.fetch_add(1, std::memory_order_relaxed);
+            m_calm_rounds = 0;
+        }
+    } else {
+        m_calm_rounds = 0;
+    }
+
+    // 缩容时投递者可能还按旧的线程数把任务放进了已退出线程的队列，叫醒一个线程去窃取
+    active = m_thread_num.load();
+    for (int i = active; i < m_max_threads; ++i) {
+        if (m_queues[i].tasks->size() > 0) {
+            for (int j = 0; j < active && !wake(j); ++j) {
+            }
+            break;
+        }
+    }
+}
+
+template <typename T>
+bool threadpool<T>::pop(worker_queue &q, queued_task &item) {
+    return q.tasks->pop(item);
+}
+
+// 从随机位置开始依次尝试别的队列，取走队头等得最久的任务
+// 已退出线程的队列也在其中，缩容时留在里面的任务会被取走
+template <typename T>
+bool threadpool<T>::steal(int id, queued_task &item) {
+    unsigned &seed = m_queues[id].seed;
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    int start = seed % m_max_threads;
+    for (int i = 0; i < m_max_threads; ++i) {
+        int victim = (start + i) % m_max_threads;
+        if (victim == id) {
+            continue;
+        }
+        if (pop(m_queues[victim], item)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+template <typename T>
+int threadpool<T>::size() const {
+    size_t n = 0;
+    for (int i = 0; i < m_max_threads; ++i) {
+        n += m_queues[i].tasks->size();
+    }
+    return (int)n;
+}
+
+template <typename T>
+void threadpool<T>::latency(histogram_snapshot &wait, histogram_snapshot &service) const {
+    wait.clear();
+    service.clear();
+    for (int i = 0; i < m_max_threads; ++i) {
+        m_queues[i].wait_hist.add_to(wait);
+        m_queues[i].service_hist.add_to(service);
+    }
+}
+
+// 把睡眠中的线程id叫醒，它本来就醒着时返回false
+template <typename T>
+bool threadpool<T>::wake(int id) {
+    worker_queue &q = m_queues[id];
+    if (q.state.load(std::memory_order_relaxed) != WORKER_PARKED) {
+        return false;
+    }
+    // 只有把状态从PARKED改回RUNNING的一方负责futex_wake，同一次睡眠不会被重复唤醒
+    int expected = WORKER_PARKED;
+    if (!q.state.compare_exchange_strong(expected, WORKER_RUNNING)) {
+        return false;
+    }
+    futex_wake(&q.state, 1);
+    return true;
 }
 
 template <typename T>
 bool threadpool<T>::append(T *task) {
-    m_queuelocker.lock();
-    // 工作队列已达上限，不予添加
-    if (m_workqueue.size() >= m_max_requests) {
-        m_queuelocker.unlock();
+    static thread_local unsigned next = 0;  // 每个投递线程各自轮转，不共享计数器
+    queued_task item = {task, now_ns()};
+    int n = m_thread_num.load(std::memory_order_relaxed);
+    int id = -1;
+    for (int i = 0; i < n; ++i) {
+        int candidate = next++ % n;
+        if (m_queues[candidate].tasks->push(item)) {
+            id = candidate;
+            break;
+        }
+    }
+    // 所有队列都满了
+    if (id < 0) {
+        m_rejected.fetch_add(1, std::memory_order_relaxed);
         return false;
     }
-    m_workqueue.push_back(task);
-    m_queuelocker.unlock();
-    // 信号量增加
-    m_queuestat.post();
+
+    // 与park()中的栅栏配对：要么睡眠的线程重新检查时看到这个任务，要么这里看到它已经睡眠
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    notify(id, n);
     return true;
 }
 
+// 任务已放入id的队列，n为当前线程数
+template <typename T>
+void threadpool<T>::notify(int id, int n) {
+    if (wake(id)) {
+        return;
+    }
+    // 队列所属线程正忙，没有线程在找活干而又有线程在睡眠时，叫醒一个来窃取
+    if (m_searching.load(std::memory_order_relaxed) == 0 &&
+        m_idle.load(std::memory_order_relaxed) > 0) {
+        for (int i = 1; i < n; ++i) {
+            if (wake((id + i) % n)) {
+                break;
+            }
+        }
+    }
+}
+
+// 把tasks的前count个放入id的队列，返回放入的个数
+template <typename T>
+int threadpool<T>::push_chunk(int id, T **tasks, int count, uint64_t now, int n) {
+    size_t pushed = m_queues[id].tasks->push_bulk(count, [&](size_t i) {
+        queued_task item = {tasks[i], now};
+        return item;
+    });
+    if (pushed > 0) {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        notify(id, n);
+    }
+    return (int)pushed;
+}
+
+template <typename T>
+int threadpool<T>::append_batch(T **tasks, int count, int cpu) {
+    static thread_local unsigned next = 0;
+    uint64_t now = now_ns();  // 同一批任务共用一个入队时间
+    int n = m_thread_num.load(std::memory_order_relaxed);
+    int done = 0;
+    // 同核的线程处理本核reactor的连接，连接对象一直留在这个核的缓存里；
+    // 它们的队列满了才分给别的线程，别的线程空闲时也会来窃取
+    if (cpu >= 0 && !m_cpus.empty()) {
+        for (int id = 0; id < n && done < count; ++id) {
+            if (worker_cpu(id) == cpu) {
+                done += push_chunk(id, tasks + done, count - done, now, n);
+            }
+        }
+    }
+    // 按线程数均分，任务少时每个线程一个；某个队列放不下的部分顺延到下一个队列
+    int chunk = (count - done + n - 1) / n;
+    for (int tried = 0; done < count && tried < 2 * n; ++tried) {
+        int id = next++ % n;
+        // 第一轮每个队列只放一段，第二轮把剩下的全部塞进还有空位的队列
+        int want = tried < n ? chunk : count - done;
+        if (want > count - done) {
+            want = count - done;
+        }
+        done += push_chunk(id, tasks + done, want, now, n);
+    }
+    if (done < count) {
+        m_rejected.fetch_add(count - done, std::memory_order_relaxed);
+    }
+    return done;
+}
+
 template <typename T>
 void *threadpool<T>::worker(void *arg) {
-    // 接收一下this指针
-    threadpool *pool = (threadpool *)arg;
-    pool->run();
+    // 接收一下线程自己的队列，从中取出this指针
+    worker_queue *q = (worker_queue *)arg;
+    q->pool->run(q->id);
     return NULL;
 }
 
+// 找不到任务时睡眠。先把状态标为PARKED再把所有队列检查一遍，
+// 这之后投递的任务一定能看到这个状态并叫醒它，不会丢失唤醒
 template <typename T>
-void threadpool<T>::run() {
-    while (!m_stop) {
-        // 等待工作队列中有任务
-        m_queuestat.wait();
+bool threadpool<T>::park(int id, queued_task &item) {
+    worker_queue &q = m_queues[id];
+    q.state.store(WORKER_PARKED);
+    m_idle.fetch_add(1);
+    m_searching.fetch_sub(1);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
 
-        m_queuelocker.lock();
-        if (m_workqueue.empty()) {
-            m_queuelocker.unlock();
-            continue;
+    bool found = pop(q, item) || steal(id, item);
+    if (found || m_stop.load() || id >= m_thread_num.load()) {
+        // 撤销睡眠；若CAS失败说明已被别人唤醒，状态已经是RUNNING
+        int expected = WORKER_PARKED;
+        q.state.compare_exchange_strong(expected, WORKER_RUNNING);
+    } else {
+        while (q.state.load(std::memory_order_acquire) == WORKER_PARKED) {
+            futex_wait(&q.state, WORKER_PARKED);
         }
-        T *task = m_workqueue.front();
-        m_workqueue.pop_front();
-        m_queuelocker.unlock();
-        if (task == NULL) {
+    }
+    m_searching.fetch_add(1);
+    m_idle.fetch_sub(1);
+    return found;
+}
+
+template <typename T>
+void threadpool<T>::run(int id) {
+    worker_queue &q = m_queues[id];
+    queued_task batch[POOL_POP_BATCH];
+    int count = 0, cur = 0;
+    uint64_t last = 0;  // 上一个任务结束的时间，紧接着取到的下一个任务直接用它作为开始时间
+    // 编号不小于当前线程数说明本线程被缩减掉了，处理完自己队列中剩下的任务后退出
+    while (!m_stop.load(std::memory_order_relaxed)) {
+        if (cur == count) {
+            // 自己的队列一次取走一半(至少一个)，减少出队的CAS次数，另一半留给窃取者
+            size_t want = q.tasks->size() / 2;
+            want = want < 1 ? 1 : (want > POOL_POP_BATCH ? POOL_POP_BATCH : want);
+            cur = 0;
+            count = q.tasks->pop_bulk(batch, want);
+        }
+        if (count == 0) {
+            if (id >= m_thread_num.load(std::memory_order_relaxed)) {
+                break;
+            }
+            m_searching.fetch_add(1);
+            bool found = steal(id, batch[0]) || park(id, batch[0]);
+            m_searching.fetch_sub(1);
+            last = 0;
+            if (!found) {
+                continue;
+            }
+            count = 1;
+        }
+        queued_task &item = batch[cur++];
+        if (item.task == NULL) {
             continue;
         }
-        task->process();
+        // 记录到本线程的直方图，没有共享写；忙碌时每个任务只多一次clock_gettime
+        uint64_t start = last != 0 ? last : now_ns();
+        // 任务可能是在上一个任务结束之后才入队的，此时没有排队
+        if (start < item.enqueue_ns) {
+            start = item.enqueue_ns;
+        }
+        q.wait_hist.record(start - item.enqueue_ns);
+        item.task->process();
+        last = now_ns();
+        q.service_hist.record(last - start);
+        q.busy_ns.store(q.busy_ns.load(std::memory_order_relaxed) + (last - start),
+                        std::memory_order_relaxed);
     }
 }
 #endif
@@ -0,0 +1,220 @@
+#include "time_wheel.h"
+
+#include <cstring>
+
+time_wheel::time_wheel() : m_current(0), m_count(0) {
+    memset(m_slots, 0, sizeof(m_slots));
+    memset(m_bitmap, 0, sizeof(m_bitmap));
+}
+
+// 时间轮被销毁时，删除其中所有的定时器
+time_wheel::~time_wheel() {
+    for (int i = 0; i < WHEEL_SLOTS; ++i) {
+        util_timer *del = m_slots[i];
+        while (del != nullptr) {
+            m_slots[i] = del->next;
+            delete del;
+            del = m_slots[i];
+        }
+    }
+}
+
+void time_wheel::link(util_timer *timer, int slot) {
+    timer->index = slot;
+    timer->prev = NULL;
+    timer->next = m_slots[slot];
+    if (timer->next != nullptr) {
+        timer->next->prev = timer;
+    }
+    m_slots[slot] = timer;
+    ++m_count;
+
+    int level = slot < WHEEL0_SIZE ? 0 : 1 + (slot - WHEEL0_SIZE) / WHEELN_SIZE;
+    int idx = slot - level_base(level);
+    m_bitmap[level][idx >> 6] |= 1ULL << (idx & 63);
+}
+
+void time_wheel::unlink(util_timer *timer) {
+    int slot = timer->index;
+    if (timer->prev != nullptr) {
+        timer->prev->next = timer->next;
+    } else {
+        m_slots[slot] = timer->next;
+    }
+    if (timer->next != nullptr) {
+        timer->next->prev = timer->prev;
+    }
+    timer->prev = timer->next = NULL;
+    timer->index = -1;
+    --m_count;
+
+    // 槽空了，清除位图中对应的位
+    if (m_slots[slot] == nullptr) {
+        int level = slot < WHEEL0_SIZE ? 0 : 1 + (slot - WHEEL0_SIZE) / WHEELN_SIZE;
+        int idx = slot - level_base(level);
+        m_bitmap[level][idx >> 6] &= ~(1ULL << (idx & 63));
+    }
+}
+
+int time_wheel::find_slot(int level, int idx) const {
+    int size = 1 << level_bits(level);
+    if (idx >= size) {
+        return -1;
+    }
+    int words = (size + 63) / 64;
+    int w = idx >> 6;
+    uint64_t word = m_bitmap[level][w] & (~0ULL << (idx & 63));
+    while (word == 0) {
+        if (++w >= words) {
+            return -1;
+        }
+        word = m_bitmap[level][w];
+    }
+    return w * 64 + __builtin_ctzll(word);
+}
+
+bool time_wheel::level_empty(int level) const {
+    return find_slot(level, 0) < 0;
+}
+
+// 根据超时时间与m_current的距离决定放在哪一层：
+// 距离不足256毫秒放入第0层，否则放入能容纳这个距离的最低一层，槽号取超时时间在该层对应的位
+void time_wheel::add_timer(util_timer *timer) {
+    if (timer == nullptr) {
+        return;
+    }
+    long long expire = timer->expire;
+    long long delta = expire - m_current;
+    int slot;
+    if (delta < 0) {
+        // 已经过期的定时器放入当前槽，下一次tick时执行
+        slot = m_current & (WHEEL0_SIZE - 1);
+    } else if (delta < WHEEL0_SIZE) {
+        slot = expire & (WHEEL0_SIZE - 1);
+    } else {
+        // 超出时间轮范围的按最远处理，级联时会按真实的超时时间重新分配
+        long long max = (1LL << (level_shift(WHEEL_LEVELS - 1) + WHEELN_BITS)) - 1;
+        if (delta > max) {
+            delta = max;
+            expire = m_current + max;
+        }
+        int level = 1;
+        while (level < WHEEL_LEVELS - 1 && delta >= (1LL << level_shift(level + 1))) {
+            ++level;
+        }
+        slot = level_base(level) + ((expire >> level_shift(level)) & (WHEELN_SIZE - 1));
+    }
+    link(timer, slot);
+}
+
+// 超时时间被修改后，从原来的槽上取下重新放入
+void time_wheel::adjust_timer(util_timer *timer) {
+    if (timer == nullptr) {
+        return;
+    }
+    unlink(timer);
+    add_timer(timer);
+}
+
+void time_wheel::del_timer(util_timer *timer) {
+    if (timer == nullptr) {
+        return;
+    }
+    unlink(timer);
+    recycle(timer);
+}
+
+void time_wheel::cascade(int level, int idx) {
+    int slot = level_base(level) + idx;
+    // 先把整个槽摘下来再逐个重新放入，重新放入的定时器都会落到更低的层
+    util_timer *cur = m_slots[slot];
+    m_slots[slot] = NULL;
+    m_bitmap[level][idx >> 6] &= ~(1ULL << (idx & 63));
+    while (cur != nullptr) {
+        util_timer *next = cur->next;
+        --m_count;
+        add_timer(cur);
+        cur = next;
+    }
+}
+
+void time_wheel::tick(long long now) {
+    // 时间轮为空时直接把当前时间拨到now之后，之后加入的定时器以此为起点
+    if (m_count == 0) {
+        if (m_current <= now) {
+            m_current = now + 1;
+        }
+        return;
+    }
+
+    while (m_current <= now) {
+        int idx = m_current & (WHEEL0_SIZE - 1);
+        // 第0层转完一圈，从上一层的当前槽取下一批定时器；上一层也转完一圈时继续往上级联
+        if (idx == 0) {
+            for (int level = 1; level < WHEEL_LEVELS; ++level) {
+                int i = (m_current >> level_shift(level)) & (WHEELN_SIZE - 1);
+                cascade(level, i);
+                if (i != 0) {
+                    break;
+                }
+            }
+        }
+
+        // 执行当前槽中所有的定时器，执行完之后回收
+        util_timer *cur;
+        while ((cur = m_slots[idx]) != nullptr) {
+            unlink(cur);
+            // 惰性刷新过的定时器按新的超时时间重新放入，一定会落到别的槽
+            if (reschedule(cur, now)) {
+                add_timer(cur);
+                continue;
+            }
+            cur->callback(cur->user_data);
+            recycle(cur);
+        }
+
+        if (m_count == 0) {
+            m_current = now + 1;
+            break;
+        }
+        // 跳过空槽：前进到第0层下一个非空槽或下一圈的开始，但不超过now+1
+        int next = find_slot(0, idx + 1);
+        m_current += (next >= 0 ? next : WHEEL0_SIZE) - idx;
+        if (m_current > now + 1) {
+            m_current = now + 1;
+        }
+    }
+}
+
+// 不逐个检查定时器，而是找出下一个需要处理的时刻：
+// 第0层中当前位置之后的第一个非空槽；若没有，则是上面某一层下一次级联的时刻
+long long time_wheel::next_expire() const {
+    if (m_count == 0) {
+        return -1;
+    }
+    long long t = m_current;
+    for (int level = 0; level < WHEEL_LEVELS; ++level) {
+        int shift = level_shift(level);
+        int round = shift + level_bits(level);  // 本层转一圈对应的位数
+        int idx = (t >> shift) & ((1 << level_bits(level)) - 1);
+        // t正好是本层一圈的开始，此时要先从上一层级联
+        if (idx == 0) {
+            for (int upper = level + 1; upper < WHEEL_LEVELS; ++upper) {
+                if (!level_empty(upper)) {
+                    return t;
+                }
+            }
+        }
+        int s = find_slot(level, idx);
+        if (s >= 0) {
+            return ((t >> round) << round) + ((long long)s << shift);
+        }
+        // 本层这一圈剩下的槽都为空，最早也要等到本层转完这一圈
+        t = ((t >> round) + 1) << round;
+        // 本层还有下一圈的定时器
+        if (!level_empty(level)) {
+            return t;
+        }
+    }
+    return t;
+}
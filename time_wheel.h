@@ -0,0 +1,56 @@
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <stdint.h>
+
+#include "lst_timer.h"
+
+// 分层时间轮的参数：第0层256个槽，每槽1毫秒；其余每层64个槽，每槽是下一层一整圈的时间
+// 四层一共覆盖2^26毫秒(约18.6小时)，更远的超时时间按最远处理
+#define WHEEL_LEVELS 4
+#define WHEEL0_BITS 8
+#define WHEELN_BITS 6
+#define WHEEL0_SIZE (1 << WHEEL0_BITS)
+#define WHEELN_SIZE (1 << WHEELN_BITS)
+#define WHEEL_SLOTS (WHEEL0_SIZE + (WHEEL_LEVELS - 1) * WHEELN_SIZE)
+
+// 分层时间轮，插入、刷新、删除都是O(1)
+// 定时器按超时时间与当前时间的距离放入对应层的槽中，第0层的槽到期时直接执行；
+// 每当第0层转完一圈，就把上一层当前槽中的定时器按剩余时间重新分配到下面各层(级联)
+class time_wheel : public timer_queue {
+public:
+    time_wheel();
+    ~time_wheel();
+
+    void add_timer(util_timer *timer);
+    void adjust_timer(util_timer *timer);
+    void del_timer(util_timer *timer);
+    void tick(long long now);
+    long long next_expire() const;
+
+private:
+    static int level_shift(int level) {
+        return level == 0 ? 0 : WHEEL0_BITS + (level - 1) * WHEELN_BITS;
+    }
+    static int level_bits(int level) {
+        return level == 0 ? WHEEL0_BITS : WHEELN_BITS;
+    }
+    static int level_base(int level) {  // 该层第一个槽在m_slots中的下标
+        return level == 0 ? 0 : WHEEL0_SIZE + (level - 1) * WHEELN_SIZE;
+    }
+
+    void link(util_timer *timer, int slot);  // 把定时器挂到槽上
+    void unlink(util_timer *timer);          // 把定时器从所在的槽上取下
+    void cascade(int level, int idx);        // 把第level层第idx个槽中的定时器重新分配
+    // 第level层中下标不小于idx的第一个非空槽，没有时返回-1
+    int find_slot(int level, int idx) const;
+    bool level_empty(int level) const;
+
+private:
+    util_timer *m_slots[WHEEL_SLOTS];                   // 每个槽是一个双向链表，只记录表头
+    uint64_t m_bitmap[WHEEL_LEVELS][WHEEL0_SIZE / 64];  // 非空槽的位图，用于跳过空槽
+    long long m_current;                                // 下一个待处理的毫秒
+    int m_count;                                        // 时间轮中的定时器个数
+};
+
+#endif
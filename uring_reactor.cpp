@@ -0,0 +1,797 @@
+#include "uring_reactor.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+
+#include "log.h"
+
+// glibc没有封装io_uring的系统调用，直接通过syscall调用
+static int io_uring_setup(unsigned entries, struct io_uring_params *p) {
+    return (int)syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int)syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+io_ring::io_ring()
+    : m_fd(-1),
+      m_sqes(NULL),
+      m_sqe_tail(0),
+      m_to_submit(0),
+      m_sq_ptr(MAP_FAILED),
+      m_cq_ptr(MAP_FAILED),
+      m_sq_len(0),
+      m_cq_len(0),
+      m_sqes_len(0) {}
+
+io_ring::~io_ring() {
+    if (m_sqes != NULL) {
+        munmap(m_sqes, m_sqes_len);
+    }
+    if (m_cq_ptr != MAP_FAILED && m_cq_ptr != m_sq_ptr) {
+        munmap(m_cq_ptr, m_cq_len);
+    }
+    if (m_sq_ptr != MAP_FAILED) {
+        munmap(m_sq_ptr, m_sq_len);
+    }
+    if (m_fd != -1) {
+        close(m_fd);
+    }
+}
+
+bool io_ring::init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    m_fd = io_uring_setup(entries, &p);
+    if (m_fd < 0) {
+        m_fd = -1;
+        return false;
+    }
+
+    // 映射提交队列和完成队列，新内核上二者共用一块内存
+    m_sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    m_cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (m_cq_len > m_sq_len) {
+            m_sq_len = m_cq_len;
+        }
+        m_cq_len = m_sq_len;
+    }
+    m_sq_ptr = mmap(0, m_sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                    IORING_OFF_SQ_RING);
+    if (m_sq_ptr == MAP_FAILED) {
+        return false;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        m_cq_ptr = m_sq_ptr;
+    } else {
+        m_cq_ptr = mmap(0, m_cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                        IORING_OFF_CQ_RING);
+        if (m_cq_ptr == MAP_FAILED) {
+            return false;
+        }
+    }
+    m_sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    void *sqes = mmap(0, m_sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_fd,
+                      IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return false;
+    }
+    m_sqes = (struct io_uring_sqe *)sqes;
+
+    char *sq = (char *)m_sq_ptr;
+    m_sq_head = (unsigned *)(sq + p.sq_off.head);
+    m_sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    m_sq_mask = *(unsigned *)(sq + p.sq_off.ring_mask);
+    m_sq_entries = *(unsigned *)(sq + p.sq_off.ring_entries);
+    m_sq_array = (unsigned *)(sq + p.sq_off.array);
+    m_sqe_tail = *m_sq_tail;
+
+    char *cq = (char *)m_cq_ptr;
+    m_cq_head = (unsigned *)(cq + p.cq_off.head);
+    m_cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    m_cq_mask = *(unsigned *)(cq + p.cq_off.ring_mask);
+    m_cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return true;
+}
+
+unsigned io_ring::sq_space() const {
+    return m_sq_entries - (m_sqe_tail - __atomic_load_n(m_sq_head, __ATOMIC_ACQUIRE));
+}
+
+bool io_ring::reserve(unsigned n) {
+    if (sq_space() < n) {
+        submit_and_wait(0);
+    }
+    return sq_space() >= n;
+}
+
+io_uring_sqe *io_ring::get_sqe() {
+    if (!reserve(1)) {
+        return NULL;
+    }
+    unsigned idx = m_sqe_tail & m_sq_mask;
+    io_uring_sqe *sqe = &m_sqes[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    m_sq_array[idx] = idx;
+    ++m_sqe_tail;
+    ++m_to_submit;
+    return sqe;
+}
+
+int io_ring::submit_and_wait(unsigned wait_nr) {
+    // 发布新的尾部，内核才能看到新填写的SQE
+    __atomic_store_n(m_sq_tail, m_sqe_tail, __ATOMIC_RELEASE);
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    int ret = io_uring_enter(m_fd, m_to_submit, wait_nr, flags);
+    if (ret < 0) {
+        return -errno;
+    }
+    m_to_submit -= ret < (int)m_to_submit ? ret : m_to_submit;
+    return ret;
+}
+
+io_uring_cqe *io_ring::peek_cqe() {
+    unsigned head = *m_cq_head;
+    if (head == __atomic_load_n(m_cq_tail, __ATOMIC_ACQUIRE)) {
+        return NULL;
+    }
+    return &m_cqes[head & m_cq_mask];
+}
+
+void io_ring::cqe_seen() {
+    __atomic_store_n(m_cq_head, *m_cq_head + 1, __ATOMIC_RELEASE);
+}
+
+bool io_ring::register_buf_ring(io_uring_buf_ring *br, unsigned entries, int bgid) {
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long)br;
+    reg.ring_entries = entries;
+    reg.bgid = bgid;
+    return io_uring_register(m_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == 0;
+}
+
+uring_reactor::uring_reactor(int id, const server_config &cfg, conn_table *conns,
+                             threadpool<http_conn> *pool)
+    : reactor(id, cfg, conns, pool),
+      m_buf_ring((io_uring_buf_ring *)MAP_FAILED),
+      m_bufs(NULL),
+      m_buf_tail(0),
+      m_recycled(false),
+      m_sq_full(false),
+      m_unarmed(0),
+      m_loop_thread(pthread_self()),
+      m_states(MAX_FD) {}
+
+uring_reactor::~uring_reactor() {
+    for (size_t fd = 0; fd < m_states.size(); ++fd) {
+        close_pipe(fd);
+    }
+    if (m_buf_ring != MAP_FAILED) {
+        munmap(m_buf_ring, URING_BUF_NUM * sizeof(struct io_uring_buf));
+    }
+    delete[] m_bufs;
+}
+
+bool uring_reactor::init() {
+    if (!reactor::init()) {
+        return false;
+    }
+
+    if (!m_ring.init(URING_ENTRIES)) {
+        perror("io_uring_setup");
+        return false;
+    }
+
+    // 接收缓冲区环必须按页对齐，这里直接用mmap分配
+    m_buf_ring = (io_uring_buf_ring *)mmap(NULL, URING_BUF_NUM * sizeof(struct io_uring_buf),
+                                           PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                           -1, 0);
+    if (m_buf_ring == MAP_FAILED) {
+        perror("mmap");
+        return false;
+    }
+    if (!m_ring.register_buf_ring(m_buf_ring, URING_BUF_NUM, URING_BGID)) {
+        perror("io_uring_register pbuf_ring");
+        return false;
+    }
+    m_bufs = new char[URING_BUF_NUM * URING_BUF_SIZE];
+    for (int i = 0; i < URING_BUF_NUM; ++i) {
+        recycle_buf(i);
+    }
+
+    arm_accept();
+    arm_poll(m_timerfd, OP_TIMER);
+    arm_poll(m_wakefd, OP_NOTIFY);
+    if (m_sigfd != -1) {
+        arm_poll(m_sigfd, OP_SIGNAL);
+    }
+    return true;
+}
+
+void uring_reactor::recycle_buf(int bid) {
+    // 不能用m_buf_ring->bufs：C++中__DECLARE_FLEX_ARRAY里的空结构体占1字节，bufs的偏移会出错
+    struct io_uring_buf *ring = (struct io_uring_buf *)m_buf_ring;
+    struct io_uring_buf *buf = &ring[m_buf_tail & (URING_BUF_NUM - 1)];
+    buf->addr = (unsigned long)(m_bufs + bid * URING_BUF_SIZE);
+    buf->len = URING_BUF_SIZE;
+    buf->bid = bid;
+    ++m_buf_tail;
+    // 发布新的尾部，内核才能取用这个缓冲区
+    __atomic_store_n(&m_buf_ring->tail, m_buf_tail, __ATOMIC_RELEASE);
+    m_recycled = true;
+}
+
+void uring_reactor::arm_accept() {
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (sqe == NULL) {
+        m_unarmed |= 1u << OP_ACCEPT;
+        m_sq_full = true;
+        return;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = m_listenfd;
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->accept_flags = SOCK_CLOEXEC;
+    sqe->user_data = make_data(OP_ACCEPT, m_listenfd, 0);
+}
+
+void uring_reactor::arm_recv(int fd) {
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (sqe == NULL) {
+        m_starved.push_back(std::make_pair(fd, m_states[fd].gen));
+        m_sq_full = true;
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fd;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BGID;
+    sqe->user_data = make_data(OP_RECV, fd, m_states[fd].gen);
+    m_states[fd].recv_armed = true;
+}
+
+void uring_reactor::retry_arms() {
+    m_sq_full = false;
+    unsigned unarmed = m_unarmed;
+    m_unarmed = 0;
+    if (unarmed & (1u << OP_ACCEPT)) {
+        arm_accept();
+    }
+    if (unarmed & (1u << OP_SIGNAL)) {
+        arm_poll(m_sigfd, OP_SIGNAL);
+    }
+    if (unarmed & (1u << OP_NOTIFY)) {
+        arm_poll(m_wakefd, OP_NOTIFY);
+    }
+    if (unarmed & (1u << OP_TIMER)) {
+        arm_poll(m_timerfd, OP_TIMER);
+    }
+    // 重试时再次失败的连接会追加到末尾，留到下一次
+    size_t n = m_starved.size();
+    for (size_t i = 0; i < n; ++i) {
+        int fd = m_starved[i].first;
+        conn_state &st = m_states[fd];
+        if (m_starved[i].second == st.gen && !st.recv_paused && !st.recv_armed) {
+            arm_recv(fd);
+        }
+    }
+    m_starved.erase(m_starved.begin(), m_starved.begin() + n);
+}
+
+void uring_reactor::arm_poll(int fd, int op) {
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    if (sqe == NULL) {
+        m_unarmed |= 1u << op;
+        m_sq_full = true;
+        return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->poll32_events = POLLIN;
+    sqe->user_data = make_data(op, fd, 0);
+}
+
+// 把响应头和文件内容作为一条链提交，前一个完成后内核才开始下一个，
+// 非最后一块带MSG_MORE，让协议栈把它们合并成尽量少的报文
+void uring_reactor::submit_send(int fd) {
+    conn_state &st = m_states[fd];
+    int file_fd, len;
+    off_t offset;
+    if (conn(fd)->get_file_body(file_fd, offset, len)) {
+        submit_splice(fd, file_fd, offset, len);
+        return;
+    }
+    int count = 0;
+    struct iovec *iov = conn(fd)->get_iov(count);
+    int n = 0;
+    struct iovec parts[2];
+    for (int i = 0; i < count; ++i) {
+        if (iov[i].iov_len > 0) {
+            parts[n++] = iov[i];
+        }
+    }
+    // 链不能跨越两次提交，先为整条链预留空间；把已有的提交掉之后仍然不够时只能关闭连接
+    if (!m_ring.reserve(n)) {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        st.busy = false;
+        close_timer(fd);
+        return;
+    }
+    st.send_error = false;
+    st.sending = n;
+    for (int i = 0; i < n; ++i) {
+        bool last = (i == n - 1);
+        io_uring_sqe *sqe = m_ring.get_sqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long)parts[i].iov_base;
+        sqe->len = parts[i].iov_len;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL | (last ? 0 : MSG_MORE);
+        sqe->flags = last ? 0 : IOSQE_IO_LINK;
+        sqe->user_data = make_data(OP_SEND, fd, st.gen);
+    }
+}
+
+// io_uring没有sendfile，用splice经管道实现：文件->管道->socket，两步链在一起，数据不经过用户态。
+// 每轮最多搬运管道容量那么多，并且让这一段在文件中的结束位置按页对齐，文件页正好占满管道的格子，
+// 搬入管道的一步不会因管道满而阻塞。搬入不完整时链被中断，已搬入的部分下一轮先送出去
+void uring_reactor::submit_splice(int fd, int file_fd, off_t offset, int len) {
+    conn_state &st = m_states[fd];
+    if (st.pipefd[0] == -1) {
+        if (pipe2(st.pipefd, O_CLOEXEC) == -1) {
+            LOG_ERROR("%s:errno is:%d", "pipe2 failure", errno);
+            st.busy = false;
+            close_timer(fd);
+            return;
+        }
+        fcntl(st.pipefd[1], F_SETPIPE_SZ, URING_PIPE_SIZE);
+    }
+    int count = 0;
+    struct iovec *iov = conn(fd)->get_iov(count);
+    bool header = iov[0].iov_len > 0;
+    int n = (header ? 1 : 0) + (st.piped > 0 ? 1 : 2);
+    if (!m_ring.reserve(n)) {
+        LOG_ERROR("%s", "io_uring submission queue full");
+        st.busy = false;
+        close_timer(fd);
+        return;
+    }
+    st.send_error = false;
+    st.sending = n;
+
+    if (header) {
+        io_uring_sqe *sqe = m_ring.get_sqe();
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = fd;
+        sqe->addr = (unsigned long)iov[0].iov_base;
+        sqe->len = iov[0].iov_len;
+        sqe->msg_flags = MSG_WAITALL | MSG_NOSIGNAL | MSG_MORE;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = make_data(OP_SEND, fd, st.gen);
+    }
+    int chunk = st.piped;
+    if (chunk == 0) {
+        // 管道是空的，先从文件搬入一段
+        int cap = fcntl(st.pipefd[1], F_GETPIPE_SZ);
+        chunk = cap - (int)(offset % 4096);
+        if (chunk > len) {
+            chunk = len;
+        }
+        io_uring_sqe *sqe = m_ring.get_sqe();
+        sqe->opcode = IORING_OP_SPLICE;
+        sqe->fd = st.pipefd[1];
+        sqe->off = (uint64_t)-1;
+        sqe->splice_fd_in = file_fd;
+        sqe->splice_off_in = offset;
+        sqe->len = chunk;
+        sqe->splice_flags = SPLICE_F_MOVE;
+        sqe->flags = IOSQE_IO_LINK;
+        sqe->user_data = make_data(OP_SPLICE_IN, fd, st.gen);
+    }
+    io_uring_sqe *sqe = m_ring.get_sqe();
+    sqe->opcode = IORING_OP_SPLICE;
+    sqe->fd = fd;
+    sqe->off = (uint64_t)-1;
+    sqe->splice_fd_in = st.pipefd[0];
+    sqe->splice_off_in = (uint64_t)-1;
+    sqe->len = chunk;
+    // 后面还有文件内容时提示协议栈不要急于发出不满的报文
+    sqe->splice_flags = SPLICE_F_MOVE | (chunk < len ? SPLICE_F_MORE : 0);
+    sqe->user_data = make_data(OP_SPLICE_OUT, fd, st.gen);
+}
+
+void uring_reactor::close_pipe(int fd) {
+    conn_state &st = m_states[fd];
+    if (st.pipefd[0] != -1) {
+        close(st.pipefd[0]);
+        close(st.pipefd[1]);
+        st.pipefd[0] = st.pipefd[1] = -1;
+    }
+    st.piped = 0;
+}
+
+void uring_reactor::rearm(http_conn *conn, int ev) {
+    if (in_loop()) {
+        deal_notify(conn->m_sockfd, ev);
+        return;
+    }
+    // 工作线程不能操作io_uring，把连接交还给reactor线程
+    m_notify_lock.lock();
+    bool wake = m_notify.empty();
+    notify_item item = {conn->m_sockfd, ev};
+    m_notify.push_back(item);
+    m_notify_lock.unlock();
+    if (wake) {
+        uint64_t one = 1;
+        ::write(m_wakefd, &one, sizeof(one));
+    }
+}
+
+bool uring_reactor::remove(http_conn *conn) {
+    int fd = conn->m_sockfd;
+    if (!in_loop()) {
+        rearm(conn, 0);
+        return false;
+    }
+    conn_state &st = m_states[fd];
+    if (st.busy) {
+        st.close_pending = true;
+        // 不是被工作线程持有，而是正在发送：对方一直不读时这条链永远不会完成，
+        // shutdown让链上的send/splice出错结束，再由handle_send关闭连接
+        if (st.sending > 0) {
+            shutdown(fd, SHUT_RDWR);
+        }
+        return false;
+    }
+    // shutdown让挂在该连接上的multishot recv以0结束，之后的完成事件因代数不同而被丢弃
+    shutdown(fd, SHUT_RDWR);
+    ++st.gen;
+    st.close_pending = false;
+    st.sending = 0;
+    st.recv_armed = false;
+    st.recv_paused = false;
+    drop_deferred(fd);
+    // 管道中可能还留有没送出的数据，不能留给下一个使用这个fd的连接
+    close_pipe(fd);
+    // fd关闭之前清空连接表中的格子，fd被复用后由accept它的reactor重新填上
+    m_conns->set(fd, NULL);
+    return true;
+}
+
+void uring_reactor::feed(int fd, int bid, int len) {
+    int n = conn(fd)->append_read(m_bufs + bid * URING_BUF_SIZE, len);
+    if (n == len) {
+        recycle_buf(bid);
+    } else {
+        // 读缓冲区已满：先处理已经收到的(交出请求体或者流水线上的请求)，剩下的等连接空闲后再交给它
+        defer(fd, bid, n, len - n);
+    }
+    dispatch(fd);
+}
+
+void uring_reactor::defer(int fd, int bid, int off, int len) {
+    conn_state &st = m_states[fd];
+    deferred_buf d = {fd, st.gen, bid, off, len};
+    m_deferred.push_back(d);
+    if (++st.deferred >= URING_DEFER_MAX && !st.recv_paused) {
+        // 取消挂着的multishot recv，取消完成之前已经收到的数据照常暂存；
+        // 提交队列满时先不暂停，下一次暂存时再取消
+        io_uring_sqe *sqe = st.recv_armed ? m_ring.get_sqe() : NULL;
+        if (!st.recv_armed || sqe != NULL) {
+            st.recv_paused = true;
+        }
+        if (sqe != NULL) {
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->addr = make_data(OP_RECV, fd, st.gen);
+            sqe->user_data = make_data(OP_CANCEL, fd, st.gen);
+        }
+    }
+}
+
+// 被取消的recv结束之前不能重新提交，免得同时挂着两个recv，数据的顺序就乱了
+void uring_reactor::resume_recv(int fd) {
+    conn_state &st = m_states[fd];
+    if (st.recv_paused && !st.recv_armed && st.deferred == 0) {
+        st.recv_paused = false;
+        arm_recv(fd);
+    }
+}
+
+// 连接收到了新数据，在发送完响应之前不再把数据交给它
+// 开启快速路径时先在本线程中解析，响应缓存命中的直接提交发送，请求不完整的继续接收；
+// 其余的添加进线程池任务队列，这一批完成事件处理完后一起投递
+void uring_reactor::dispatch(int fd) {
+    m_states[fd].busy = true;
+    refresh_timer(fd, conn(fd)->reading_body() ? TIMEOUT_BODY : TIMEOUT_HEADER);
+    if (m_cfg.inline_hits && conn(fd)->process_inline()) {
+        deal_notify(fd, conn(fd)->get_bytes_to_send() > 0 ? EPOLLOUT : EPOLLIN);
+    } else {
+        queue_task(fd);
+    }
+}
+
+void uring_reactor::idle(int fd) {
+    conn_state &st = m_states[fd];
+    st.busy = false;
+    if (st.close_pending) {
+        http_conn *user = conn(fd);
+        user->close_conn();
+        release_conn(user);
+        return;
+    }
+    // 忙碌期间收到的数据按顺序交给连接，读缓冲区放不下时剩下的继续暂存，等处理完已收到的再交给它
+    bool got = false, full = false;
+    size_t j = 0;
+    for (size_t i = 0; i < m_deferred.size(); ++i) {
+        deferred_buf &d = m_deferred[i];
+        if (d.fd == fd && d.gen == st.gen && !full) {
+            int n = conn(fd)->append_read(m_bufs + d.bid * URING_BUF_SIZE + d.off, d.len);
+            got = got || n > 0;
+            if (n == d.len) {
+                --st.deferred;
+                recycle_buf(d.bid);
+                continue;
+            }
+            d.off += n;
+            d.len -= n;
+            full = true;
+        }
+        m_deferred[j++] = d;
+    }
+    m_deferred.resize(j);
+    resume_recv(fd);
+    // 流水线上留到这一批之后的请求已经在读缓冲区中，同样要接着处理
+    if (got || conn(fd)->has_pending()) {
+        dispatch(fd);
+    }
+}
+
+void uring_reactor::reject(int fd) {
+    // 连接没有交给工作线程，恢复空闲才能正常关闭
+    m_states[fd].busy = false;
+    reactor::reject(fd);
+}
+
+void uring_reactor::drop_deferred(int fd) {
+    size_t j = 0;
+    for (size_t i = 0; i < m_deferred.size(); ++i) {
+        if (m_deferred[i].fd == fd) {
+            recycle_buf(m_deferred[i].bid);
+        } else {
+            m_deferred[j++] = m_deferred[i];
+        }
+    }
+    m_deferred.resize(j);
+    m_states[fd].deferred = 0;
+}
+
+void uring_reactor::handle_accept(int res, unsigned flags) {
+    if (res >= 0) {
+        // multishot accept不返回对端地址，日志中以fd标识连接
+        struct sockaddr_in client_addr;
+        memset(&client_addr, 0, sizeof(client_addr));
+        if (add_conn(res, client_addr)) {
+            conn_state &st = m_states[res];
+            st.busy = false;
+            st.close_pending = false;
+            st.sending = 0;
+            arm_recv(res);
+        }
+    } else {
+        LOG_ERROR("%s:errno is:%d", "accept error", -res);
+    }
+    // multishot请求被内核终止，需要重新挂上
+    if (!(flags & IORING_CQE_F_MORE)) {
+        arm_accept();
+    }
+}
+
+void uring_reactor::handle_recv(int fd, unsigned gen, int res, unsigned flags) {
+    conn_state &st = m_states[fd];
+    int bid = -1;
+    if (flags & IORING_CQE_F_BUFFER) {
+        bid = flags >> IORING_CQE_BUFFER_SHIFT;
+    }
+    // 连接已经关闭，这是旧连接的完成事件
+    if (gen != st.gen) {
+        if (bid >= 0) {
+            recycle_buf(bid);
+        }
+        return;
+    }
+
+    if (!(flags & IORING_CQE_F_MORE)) {
+        st.recv_armed = false;
+    }
+
+    if (res > 0) {
+        if (st.busy) {
+            defer(fd, bid, 0, res);
+        } else {
+            feed(fd, bid, res);
+        }
+        if (!(flags & IORING_CQE_F_MORE) && gen == st.gen) {
+            if (st.recv_paused) {
+                resume_recv(fd);
+            } else {
+                arm_recv(fd);
+            }
+        }
+    } else if (res == -ECANCELED && st.recv_paused) {
+        // 暂停接收时取消的，暂存的数据已经处理完时立即恢复
+        resume_recv(fd);
+    } else if (res == -ENOBUFS) {
+        // 缓冲区耗尽，等有缓冲区归还后再重新接收
+        m_starved.push_back(std::make_pair(fd, gen));
+    } else {
+        // 对方关闭连接或出错，结束该用户
+        close_timer(fd);
+    }
+}
+
+void uring_reactor::handle_send(int fd, int op, unsigned gen, int res) {
+    conn_state &st = m_states[fd];
+    if (gen != st.gen) {
+        return;
+    }
+    if (op == OP_SPLICE_IN) {
+        // 只是搬进了管道，还没有发出去；文件在发送期间被截短时读不到数据，无法发完声明的长度
+        if (res > 0) {
+            st.piped += res;
+        } else if (res != -ECANCELED) {
+            st.send_error = true;
+        }
+    } else if (res > 0) {
+        if (op == OP_SPLICE_OUT) {
+            st.piped -= res;
+        }
+        conn(fd)->advance_write(res);
+        refresh_timer(fd, TIMEOUT_WRITE);
+    } else if (res != -ECANCELED) {
+        st.send_error = true;
+    }
+    if (--st.sending > 0) {
+        return;
+    }
+
+    // 这一条链全部完成
+    if (st.send_error) {
+        st.busy = false;
+        close_timer(fd);
+    } else if (conn(fd)->get_bytes_to_send() > 0) {
+        // 发送不完整(链被中断)，从断点继续发送
+        submit_send(fd);
+    } else {
+        finish_send(fd);
+    }
+}
+
+// 响应发送完毕，保持连接则重新空闲，否则关闭
+void uring_reactor::finish_send(int fd) {
+    if (conn(fd)->finish_write()) {
+        refresh_timer(fd, TIMEOUT_IDLE);
+        idle(fd);
+    } else {
+        m_states[fd].busy = false;
+        close_timer(fd);
+    }
+}
+
+void uring_reactor::deal_notify(int fd, int ev) {
+    conn_state &st = m_states[fd];
+    if (ev == 0) {
+        // 工作线程要求关闭
+        st.busy = false;
+        close_timer(fd);
+    } else if (ev & EPOLLOUT) {
+        // 响应已生成，开始发送
+        if (st.close_pending) {
+            idle(fd);
+        } else if (conn(fd)->get_bytes_to_send() == 0) {
+            finish_send(fd);
+        } else {
+            submit_send(fd);
+        }
+    } else {
+        // 请求不完整，等待更多数据
+        idle(fd);
+    }
+}
+
+void uring_reactor::handle_notify() {
+    deal_wakeup();
+
+    m_notify_lock.lock();
+    m_handling.swap(m_notify);
+    m_notify_lock.unlock();
+
+    for (size_t i = 0; i < m_handling.size(); ++i) {
+        deal_notify(m_handling[i].fd, m_handling[i].ev);
+    }
+    m_handling.clear();
+}
+
+void uring_reactor::loop() {
+    m_loop_thread = pthread_self();
+
+    while (!m_stop) {
+        // 提交本轮产生的请求，并等待至少一个完成事件；有请求没能挂上时不等待，提交后立即重试
+        int ret = m_ring.submit_and_wait(m_sq_full ? 0 : 1);
+        if (ret < 0 && ret != -EINTR && ret != -EAGAIN && ret != -EBUSY) {
+            LOG_ERROR("%s:errno is:%d", "io_uring_enter failure", -ret);
+            break;
+        }
+        update_time();
+        // 上一轮提交队列满时没能挂上的请求，刚提交过一次，现在重试
+        if (m_sq_full) {
+            retry_arms();
+        }
+
+        m_recycled = false;
+        io_uring_cqe *cqe;
+        while ((cqe = m_ring.peek_cqe()) != NULL) {
+            uint64_t data = cqe->user_data;
+            int res = cqe->res;
+            unsigned flags = cqe->flags;
+            m_ring.cqe_seen();
+
+            int op = data & 0xff;
+            int fd = (data >> 8) & 0xffffff;
+            unsigned gen = data >> 32;
+            switch (op) {
+                case OP_ACCEPT: handle_accept(res, flags); break;
+                case OP_RECV: handle_recv(fd, gen, res, flags); break;
+                case OP_SEND:
+                case OP_SPLICE_IN:
+                case OP_SPLICE_OUT: handle_send(fd, op, gen, res); break;
+                case OP_SIGNAL: {
+                    deal_signal();
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        arm_poll(m_sigfd, OP_SIGNAL);
+                    }
+                    break;
+                }
+                case OP_NOTIFY: {
+                    handle_notify();
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        arm_poll(m_wakefd, OP_NOTIFY);
+                    }
+                    break;
+                }
+                case OP_TIMER: {
+                    deal_timer();
+                    if (!(flags & IORING_CQE_F_MORE)) {
+                        arm_poll(m_timerfd, OP_TIMER);
+                    }
+                    break;
+                }
+                default: break;
+            }
+        }
+
+        // 有缓冲区归还了，让之前因缓冲区耗尽而停下的连接重新接收
+        if (m_recycled && !m_starved.empty()) {
+            retry_arms();
+        }
+
+        flush_tasks();
+        after_loop();
+    }
+}
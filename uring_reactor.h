@@ -0,0 +1,188 @@
+#ifndef URING_REACTOR_H
+#define URING_REACTOR_H
+
+#include <linux/io_uring.h>
+#include <stdint.h>
+
+#include <utility>
+#include <vector>
+
+#include "locker.h"
+#include "reactor.h"
+
+#define URING_ENTRIES 4096   // 提交队列长度
+#define URING_BUF_NUM 1024   // 提供给内核的接收缓冲区个数，必须是2的幂
+#define URING_BUF_SIZE 2048  // 每个接收缓冲区的大小
+#define URING_BGID 0         // 接收缓冲区组号
+// 一个连接最多暂存的接收缓冲区个数，达到时暂停接收这个连接，免得上传很快的客户端占满缓冲区环
+#define URING_DEFER_MAX 32
+#define URING_PIPE_SIZE (256 * 1024)  // splice用的管道容量，也是一次从文件搬入管道的最大字节数
+
+// 对io_uring系统调用的最小封装：映射SQ/CQ环形队列，提供取SQE、提交等待、遍历CQE的接口
+// 只允许reactor线程使用
+class io_ring {
+public:
+    io_ring();
+    ~io_ring();
+
+    bool init(unsigned entries);
+    // 确保提交队列至少有n个空位，不够时先把已有的提交给内核，仍然不够时返回false。
+    // 一条链要先一次预留好所有SQE，否则中途的提交会把链拆开
+    bool reserve(unsigned n);
+    // 获取一个清零的SQE，提交队列满时先把已有的提交给内核，仍然满时返回NULL
+    io_uring_sqe *get_sqe();
+    // 提交队列剩余空间
+    unsigned sq_space() const;
+    // 提交所有SQE，并等待至少wait_nr个完成事件，返回值同io_uring_enter
+    int submit_and_wait(unsigned wait_nr);
+    // 取出下一个完成事件，没有时返回NULL，处理完后调用cqe_seen()
+    io_uring_cqe *peek_cqe();
+    void cqe_seen();
+    // 注册接收缓冲区环
+    bool register_buf_ring(io_uring_buf_ring *br, unsigned entries, int bgid);
+
+private:
+    int m_fd;  // io_uring实例
+
+    // 提交队列
+    unsigned *m_sq_head;
+    unsigned *m_sq_tail;
+    unsigned *m_sq_array;
+    unsigned m_sq_mask;
+    unsigned m_sq_entries;
+    io_uring_sqe *m_sqes;
+    unsigned m_sqe_tail;   // 本地已填写的SQE尾部
+    unsigned m_to_submit;  // 已填写但尚未提交的SQE个数
+
+    // 完成队列
+    unsigned *m_cq_head;
+    unsigned *m_cq_tail;
+    unsigned m_cq_mask;
+    io_uring_cqe *m_cqes;
+
+    // 映射的内存
+    void *m_sq_ptr;
+    void *m_cq_ptr;
+    size_t m_sq_len;
+    size_t m_cq_len;
+    size_t m_sqes_len;
+};
+
+// 基于io_uring的事件后端：完成通知模型
+// 监听socket上挂一个multishot accept，每个连接上挂一个multishot recv，
+// 数据由内核直接收进注册的缓冲区环中，响应头和文件内容用链式send一次提交；
+// 大文件没有映射，文件内容经每个连接自己的管道用链式splice从页缓存送入socket。
+// 工作线程不能直接操作io_uring，处理完毕后通过唤醒用的eventfd把连接交还给reactor线程。
+class uring_reactor : public reactor {
+public:
+    uring_reactor(int id, const server_config &cfg, conn_table *conns,
+                  threadpool<http_conn> *pool);
+    ~uring_reactor();
+
+    bool init();
+    void loop();
+    void rearm(http_conn *conn, int ev);
+    bool remove(http_conn *conn);
+
+protected:
+    void reject(int fd);
+
+private:
+    // 请求类型，编码在user_data的低8位
+    // OP_SPLICE_IN把文件搬入管道，OP_SPLICE_OUT把管道中的数据送入socket
+    enum OP {
+        OP_ACCEPT = 1,
+        OP_RECV,
+        OP_SEND,
+        OP_SPLICE_IN,
+        OP_SPLICE_OUT,
+        OP_SIGNAL,
+        OP_NOTIFY,
+        OP_TIMER,
+        OP_CANCEL
+    };
+
+    // 每个连接在io_uring上的状态
+    struct conn_state {
+        unsigned gen;        // 连接的代数，fd被复用后旧请求的完成事件据此丢弃
+        bool busy;           // 连接正被工作线程处理或正在发送响应，此时收到的数据先暂存
+        bool close_pending;  // 忙碌期间被要求关闭，空闲后再关闭
+        bool send_error;     // 本轮发送出错
+        int sending;         // 尚未完成的send/splice请求个数
+        int pipefd[2] = {-1, -1};  // splice用的管道，第一次发送大文件时创建，连接关闭时关闭
+        int piped = 0;             // 已搬入管道、还没送入socket的字节数
+        int deferred = 0;          // 暂存的接收缓冲区个数
+        bool recv_armed = false;   // multishot recv是否还挂着
+        bool recv_paused = false;  // 暂存的数据太多，暂停了接收
+    };
+    // 工作线程交还给reactor的连接，ev为EPOLLIN/EPOLLOUT，0表示关闭
+    struct notify_item {
+        int fd;
+        int ev;
+    };
+    // 连接忙碌时收到的数据，缓冲区暂不归还
+    struct deferred_buf {
+        int fd;
+        unsigned gen;
+        int bid;
+        int off;  // 前off个字节已经交给了连接
+        int len;
+    };
+
+    static uint64_t make_data(int op, int fd, unsigned gen) {
+        return ((uint64_t)gen << 32) | ((uint64_t)fd << 8) | op;
+    }
+    bool in_loop() const {
+        return pthread_equal(pthread_self(), m_loop_thread);
+    }
+
+    // 以下三个在提交队列满时记下来，下一轮提交之后由retry_arms()重试
+    void arm_accept();              // 在监听socket上挂multishot accept
+    void arm_recv(int fd);          // 在连接上挂multishot recv
+    void arm_poll(int fd, int op);  // 在signalfd、eventfd或timerfd上挂multishot poll
+    void retry_arms();              // 重新挂上之前没能挂上的accept、poll和recv
+    void submit_send(int fd);       // 把待发送的数据块用链式send提交
+    // 响应头(如果还有)用send提交，文件内容用链式splice经管道送入socket
+    void submit_splice(int fd, int file_fd, off_t offset, int len);
+    void close_pipe(int fd);
+    void recycle_buf(int bid);      // 把接收缓冲区归还给内核
+
+    void handle_accept(int res, unsigned flags);
+    void handle_recv(int fd, unsigned gen, int res, unsigned flags);
+    void handle_send(int fd, int op, unsigned gen, int res);
+    void finish_send(int fd);
+    void handle_notify();
+    void deal_notify(int fd, int ev);
+    // 把收到的数据交给连接，并派发出去
+    void feed(int fd, int bid, int len);
+    // 暂存连接收到的数据，暂存的太多时暂停接收
+    void defer(int fd, int bid, int off, int len);
+    void resume_recv(int fd);  // 暂存的数据都交给连接后恢复接收
+    // 处理连接收到的数据：响应缓存命中的直接发送，其余的交给线程池
+    void dispatch(int fd);
+    // 连接重新空闲，处理暂存的数据
+    void idle(int fd);
+    void drop_deferred(int fd);
+
+private:
+    io_ring m_ring;
+    io_uring_buf_ring *m_buf_ring;  // 接收缓冲区环
+    char *m_bufs;                   // 接收缓冲区
+    unsigned short m_buf_tail;      // 缓冲区环本地尾部
+    bool m_recycled;                // 本轮是否归还过缓冲区
+    bool m_sq_full;                 // 是否有请求因提交队列满而没能挂上
+    unsigned m_unarmed;             // 没能挂上的accept和poll，按1 << OP记录
+
+    pthread_t m_loop_thread;           // 事件循环所在线程
+    std::vector<conn_state> m_states;  // 下标为fd
+
+    locker m_notify_lock;                 // 保护m_notify
+    std::vector<notify_item> m_notify;    // 工作线程交还的连接
+    std::vector<notify_item> m_handling;  // reactor线程正在处理的交还连接
+
+    std::vector<deferred_buf> m_deferred;  // 连接忙碌时暂存的数据
+    // 因缓冲区耗尽或者提交队列满而停止接收的连接及其代数
+    std::vector<std::pair<int, unsigned> > m_starved;
+};
+
+#endif